@@ -1,28 +1,41 @@
 ﻿#pragma once
 
+#include <climits>
 #include <cstdint>
-#include <fstream>
+#include <iostream>
 
 /**
- * @brief Klasa opakowująca std::fstream. Umożliwia pisanie i czytanie, z i do
- * pliku, pojedyczych bitów
+ * @brief Klasa opakowująca std::iostream (zwykle std::fstream). Umożliwia
+ * pisanie i czytanie, z i do pliku, pojedyczych bitów
  */
 class bit_file_io
 {
   private:
-    std::fstream &file_stream_;
-    // buffers for bit manipulation
-    uint8_t r_bit_buf_ = 0, r_bit_buf_size_ = 0;
-    uint8_t w_bit_buf_ = 0, w_bit_buf_size_ = 0;
+    std::iostream &file_stream_;
+    // 64 bit accumulators for bit manipulation, bits are kept MSB-first
+    // r_bit_buf_size_ goes below zero when reading past the end of file
+    uint64_t r_bit_buf_ = 0, w_bit_buf_ = 0;
+    int r_bit_buf_size_ = 0;
+    uint8_t w_bit_buf_size_ = 0;
 
     // buffers for reading/writing from/to file
     uint8_t *r_buff_;
-    size_t r_buff_cnt_ = 0, r_buff_size_;
+    size_t r_buff_pos_ = 0, r_buff_cnt_ = 0, r_buff_size_;
     uint8_t *w_buff_;
     size_t w_buff_cnt_ = 0, w_buff_size_;
 
+    bool fill_read_buffer();
+    void flush_bits();
+
   public:
-    bit_file_io(std::fstream &file_stream, size_t read_buff_size,
+    /**
+     * @brief Maksymalna liczba bitów, którą można zapisać jednym wywołaniem
+     * write_bits oraz minimalna liczba bitów dostępnych po refill (o ile plik
+     * się nie skończył)
+     */
+    static constexpr uint8_t max_bits = 56;
+
+    bit_file_io(std::iostream &file_stream, size_t read_buff_size,
                 size_t write_buff_size);
     ~bit_file_io();
 
@@ -32,6 +45,24 @@ class bit_file_io
      */
     void write_bit(uint8_t bit);
 
+    /**
+     * @brief Pisze do pliku count najmłodszych bitów z bits, zaczynając od
+     * najstarszego z nich
+     * @param bits - bity do wypisania, wyrównane do prawej
+     * @param count - liczba bitów, nie większa niż max_bits
+     */
+    void write_bits(const uint64_t bits, const uint8_t count)
+    {
+        if (count == 0)
+            return;
+
+        this->w_bit_buf_ |= bits << (64 - this->w_bit_buf_size_ - count);
+        this->w_bit_buf_size_ += count;
+
+        if (this->w_bit_buf_size_ >= CHAR_BIT)
+            flush_bits();
+    }
+
     /**
      * @brief Powoduje wypisanie i wyczyszczenie buforu bitów
      */
@@ -50,6 +81,81 @@ class bit_file_io
      */
     bool read_bit(uint8_t &bit);
 
+    /**
+     * @brief Uzupełnia bufor bitów tak, aby zawierał co najmniej max_bits
+     * bitów. Po końcu pliku bufor jest uzupełniany zerami
+     */
+    void refill()
+    {
+        if (this->r_bit_buf_size_ < 0 || this->r_bit_buf_size_ > max_bits)
+            return;
+
+        // fast path, load whole 8 bytes and keep as many as fit
+        if (this->r_buff_pos_ + sizeof(uint64_t) <= this->r_buff_cnt_)
+        {
+            const uint8_t *src = this->r_buff_ + this->r_buff_pos_;
+            uint64_t word = 0;
+            for (size_t i = 0; i < sizeof(uint64_t); i++)
+                word = (word << CHAR_BIT) | src[i];
+
+            const int bytes = (63 - this->r_bit_buf_size_) / CHAR_BIT;
+            this->r_bit_buf_ |= word >> this->r_bit_buf_size_;
+            this->r_buff_pos_ += bytes;
+            this->r_bit_buf_size_ += bytes * CHAR_BIT;
+            return;
+        }
+
+        while (this->r_bit_buf_size_ <= max_bits)
+        {
+            if (this->r_buff_pos_ == this->r_buff_cnt_ && !fill_read_buffer())
+                return;
+            this->r_bit_buf_ |= static_cast<uint64_t>(
+                                    this->r_buff_[this->r_buff_pos_++])
+                                << (64 - CHAR_BIT - this->r_bit_buf_size_);
+            this->r_bit_buf_size_ += CHAR_BIT;
+        }
+    }
+
+    /**
+     * @brief Zwraca count kolejnych bitów bez ich zużywania
+     * @param count - liczba bitów, od 1 do max_bits
+     * @return uint64_t - bity wyrównane do prawej
+     */
+    uint64_t peek_bits(const uint8_t count) const
+    {
+        return this->r_bit_buf_ >> (64 - count);
+    }
+
+    /**
+     * @brief Zużywa count bitów z bufora bitów
+     * @param count - liczba bitów, nie większa niż max_bits
+     */
+    void skip_bits(const uint8_t count)
+    {
+        this->r_bit_buf_ <<= count;
+        this->r_bit_buf_size_ -= count;
+    }
+
+    /**
+     * @brief Czyta count kolejnych bitów. Za końcem pliku zwraca zera, co
+     * można sprawdzić przez overrun
+     * @param count - liczba bitów, od 1 do max_bits
+     * @return uint64_t - bity wyrównane do prawej
+     */
+    uint64_t read_bits(const uint8_t count)
+    {
+        this->refill();
+        const uint64_t bits = this->peek_bits(count);
+        this->skip_bits(count);
+        return bits;
+    }
+
+    /**
+     * @brief Sprawdza czy zużyto więcej bitów niż było dostępnych w pliku
+     * @return true - jeżeli czytano za końcem pliku
+     */
+    bool overrun() const { return this->r_bit_buf_size_ < 0; }
+
     bit_file_io &operator<<(const uint8_t bit);
     bool operator>>(uint8_t &bit);
 };
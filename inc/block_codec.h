@@ -0,0 +1,266 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bit_file_io.h"
+#include "block_transform.h"
+#include "canonical_code.h"
+#include "consts.h"
+#include "huffman_kernels.h"
+#include "lz77.h"
+
+/**
+ * @brief Typ bloku formatu blokowego
+ */
+enum class block_type : uint8_t
+{
+    END = 0,
+    HUFFMAN = 1,
+    // bytes copied without coding
+    STORED = 2,
+    // code table of the following REUSE blocks, decodes to no bytes
+    CODE_TABLE = 3,
+    // bytes coded with the last code table, payload has codes only
+    REUSE = 4,
+    // code lengths changed since the last code table, decodes to no bytes
+    DELTA_TABLE = 5,
+};
+
+/**
+ * @brief Przetwarzanie bloków przed kodowaniem Huffmana
+ */
+enum class block_pipeline : uint8_t
+{
+    // bytes coded directly
+    HUFFMAN = 0,
+    // run length coding of repeated bytes
+    RLE = 1,
+    // burrows-wheeler, move-to-front and zero run coding
+    BWT = 2,
+    // lz77 matches, literals with lengths and distances use separate codes
+    LZ77 = 3,
+};
+
+/**
+ * @brief Opcje kompresji blokowej
+ */
+struct compression_options
+{
+    // block format even without any block processing
+    bool block_format = false;
+    // every block is stored without coding
+    bool stored = false;
+    block_pipeline pipeline = block_pipeline::HUFFMAN;
+    // bytes at the beginning of a block used to estimate its histogram, 0
+    // for the whole block. Every byte gets one more occurrence, so bytes
+    // missing in the sample still have codes
+    size_t sample_size = 0;
+    // bytes of the input used to estimate one code table of the whole file,
+    // 0 for a table per block. Blocks are coded in the same pass that reads
+    // them, only with block_pipeline::HUFFMAN. Every byte gets one more
+    // occurrence, so bytes missing in the sample still have codes
+    size_t table_sample = 0;
+    // table_sample is taken from chunks spread evenly over the input
+    // instead of its beginning
+    bool strided_sample = false;
+    // blocks of block_pipeline::HUFFMAN keep the code table of the previous
+    // block while its own table would save at most reuse_threshold bytes
+    // more than a delta of the table takes. Changed tables are written as
+    // deltas
+    bool reuse_tables = false;
+    size_t reuse_threshold = 0;
+    // match finder parameters of block_pipeline::LZ77
+    lz77_params lz77;
+    // blocks coded at once, 0 for one per hardware thread
+    unsigned threads = 0;
+    // bytes of input coded together, with its own code table
+    size_t block_size = size_1_mb;
+    // longest code allowed, shorter codes keep decoding table small
+    uint8_t max_code_length = 16;
+
+    /**
+     * @brief Najniższy i najwyższy poziom kompresji
+     */
+    static constexpr int min_level = 1;
+    static constexpr int max_level = 9;
+
+    /**
+     * @brief Zwraca opcje poziomu kompresji. Poziom 1 zapisuje bloki bez
+     * kodowania, 2-4 kodują bajty kodem Huffmana z histogramu próbki lub
+     * całego bloku, zachowując tablicę poprzedniego bloku, gdy nowa niewiele
+     * by zmieniła, 5-8 używają LZ77 z coraz dłuższym szukaniem dopasowań,
+     * a 9 BWT. Poziomy 8 i 9 używają optymalnych kodów, niższe kodów o
+     * ograniczonej długości, które dekodują się szybciej
+     *
+     * @param level - poziom od min_level do max_level
+     * @return compression_options - opcje poziomu
+     */
+    static compression_options from_level(int level);
+
+    /**
+     * @brief Sprawdza, czy opcje wymagają formatu blokowego
+     * @return true - jeżeli włączono którykolwiek etap przetwarzania bloków
+     */
+    bool uses_blocks() const
+    {
+        return this->block_format || this->stored || this->table_sample ||
+               this->pipeline != block_pipeline::HUFFMAN;
+    }
+};
+
+/**
+ * @brief Kod zapisany w bloku block_type::CODE_TABLE lub
+ * block_type::DELTA_TABLE razem z tablicami kodowania, używany przez kolejne
+ * bloki block_type::REUSE. Koder może włączyć tablicę kodów par bajtów
+ * (huffman_kernels::enable_pair_codes), dekoder jej nie potrzebuje
+ */
+struct shared_code
+{
+    canonical_code code;
+    huffman_kernels kernels;
+
+    explicit shared_code(canonical_code table, const bool pair_codes = false)
+        : code(std::move(table)), kernels(this->code)
+    {
+        if (pair_codes)
+            this->kernels.enable_pair_codes();
+    }
+    shared_code(const shared_code &) = delete;
+    shared_code &operator=(const shared_code &) = delete;
+};
+
+/**
+ * @brief Koduje i dekoduje pojedyncze bloki formatu blokowego. Każdy blok ma
+ * własny kanoniczny kod Huffmana, zapisany jako długości kodów, albo używa
+ * kodu współdzielonego z bloku block_type::CODE_TABLE. Przed kodowaniem blok
+ * przechodzi przez etapy block_transform, a bajty mogą być zamienione na
+ * symbole kodowania serii. Metody są stałe, więc jeden obiekt
+ * może kodować wiele bloków równolegle
+ */
+class block_codec
+{
+  private:
+    compression_options options_;
+    std::vector<std::unique_ptr<block_transform>> transforms_;
+
+    void encode_lz77(const uint8_t *data, size_t size, bit_file_io &out,
+                     uint64_t &encoded_bits) const;
+    void decode_lz77(bit_file_io &in, uint8_t *out, size_t size) const;
+    uint64_t encode_huffman(const uint8_t *data, size_t size,
+                            bit_file_io &out) const;
+    void decode_huffman(bit_file_io &in, uint8_t *out, size_t size) const;
+
+  public:
+    /**
+     * @brief Tworzy koder bloków
+     *
+     * @param options - opcje kompresji, przy dekodowaniu istotne jest tylko
+     * przetwarzanie odczytane z nagłówka pliku
+     */
+    explicit block_codec(const compression_options &options);
+
+    /**
+     * @brief Zwraca największy poprawny rozmiar zakodowanego bloku
+     *
+     * @param size - rozmiar bloku przed kodowaniem
+     * @return size_t - maksymalny rozmiar zakodowanego bloku
+     */
+    static size_t max_payload_size(size_t size);
+
+    /**
+     * @brief Koduje blok. Blok, którego kod nie byłby krótszy od niego
+     * samego, jest zapisywany bez kodowania
+     *
+     * @param data - blok bajtów
+     * @param size - rozmiar bloku, nie większy niż UINT32_MAX
+     * @param[out] payload - zakodowany blok
+     * @param[out] type - typ bloku, block_type::HUFFMAN lub block_type::STORED
+     * @return uint64_t - liczba bitów kodu, bez tablicy kodów i dopełnienia
+     */
+    uint64_t encode(const uint8_t *data, size_t size, std::string &payload,
+                    block_type &type) const;
+
+    /**
+     * @brief Dekoduje blok
+     *
+     * @param type - typ bloku
+     * @param payload - zakodowany blok
+     * @param[out] out - bufor na bajty
+     * @param size - rozmiar bloku przed kodowaniem
+     * @param shared - kod ostatniego bloku z tablicą kodów, wymagany przez
+     * bloki block_type::REUSE
+     * @throw std::logic_error - jeżeli blok jest obcięty lub uszkodzony
+     */
+    void decode(block_type type, const std::string &payload, uint8_t *out,
+                size_t size, const shared_code *shared = nullptr) const;
+
+    /**
+     * @brief Koduje blok kodem współdzielonym, bez własnej tablicy kodów.
+     * Blok, którego kod nie byłby krótszy od niego samego, jest zapisywany
+     * bez kodowania
+     *
+     * @param shared - kod bajtów
+     * @param data - blok bajtów
+     * @param size - rozmiar bloku, nie większy niż UINT32_MAX
+     * @param[out] payload - zakodowany blok
+     * @param[out] type - typ bloku, block_type::REUSE lub block_type::STORED
+     * @return uint64_t - liczba bitów kodu, bez dopełnienia
+     */
+    uint64_t encode(const shared_code &shared, const uint8_t *data,
+                    size_t size, std::string &payload, block_type &type) const;
+
+    /**
+     * @brief Liczy częstotliwości bajtów bloku, z próbki lub całego bloku
+     * zależnie od opcji, i buduje z nich kod
+     *
+     * @param data - blok bajtów
+     * @param size - rozmiar bloku
+     * @param[out] map - częstotliwości bajtów
+     * @return canonical_code - kod bajtów bloku
+     */
+    canonical_code byte_code(const uint8_t *data, size_t size,
+                             freq_map &map) const;
+
+    /**
+     * @brief Sprawdza, czy blok powinien zachować poprzednią tablicę kodów.
+     * Porównuje szacowany rozmiar kodów bloku przy obu kodach z rozmiarem
+     * delty tablicy i progiem z opcji
+     *
+     * @param previous - kod poprzedniego bloku
+     * @param code - kod zbudowany dla bloku przez byte_code
+     * @param map - częstotliwości bajtów bloku z byte_code
+     * @param size - rozmiar bloku
+     * @return true - jeżeli blok powinien użyć kodu previous
+     */
+    bool reuses_table(const canonical_code &previous,
+                      const canonical_code &code, const freq_map &map,
+                      size_t size) const;
+
+    /**
+     * @brief Zapisuje tablicę kodów bloku block_type::CODE_TABLE albo, gdy
+     * podano poprzedni kod, zmiany długości bloku block_type::DELTA_TABLE
+     *
+     * @param code - kod bajtów
+     * @param[out] payload - zakodowana tablica
+     * @param previous - poprzedni kod lub nullptr
+     */
+    static void encode_table(const canonical_code &code, std::string &payload,
+                             const canonical_code *previous = nullptr);
+
+    /**
+     * @brief Odczytuje tablicę kodów bloku block_type::CODE_TABLE albo
+     * block_type::DELTA_TABLE, gdy podano poprzedni kod
+     *
+     * @param payload - zakodowana tablica
+     * @param previous - poprzedni kod lub nullptr
+     * @return std::shared_ptr<const shared_code> - kod dla kolejnych bloków
+     * @throw std::logic_error - jeżeli tablica jest obcięta lub uszkodzona
+     */
+    static std::shared_ptr<const shared_code>
+    decode_table(const std::string &payload,
+                 const shared_code *previous = nullptr);
+};
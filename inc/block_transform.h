@@ -0,0 +1,66 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Etap przetwarzania bloku przed kodowaniem Huffmana. Etap nie
+ * zmienia rozmiaru bloku, a dane potrzebne do odwrócenia przekształcenia
+ * zwraca jako parametr zapisywany w nagłówku bloku
+ */
+class block_transform
+{
+  public:
+    virtual ~block_transform() = default;
+
+    /**
+     * @brief Zwraca liczbę bitów parametru zapisywanego w nagłówku bloku
+     * @return uint8_t - liczba bitów, 0 jeżeli etap nie ma parametru
+     */
+    virtual uint8_t parameter_bits() const = 0;
+
+    /**
+     * @brief Przekształca blok
+     *
+     * @param[in,out] block - blok bajtów
+     * @return uint32_t - parametr potrzebny do odwrócenia przekształcenia
+     */
+    virtual uint32_t forward(std::vector<uint8_t> &block) const = 0;
+
+    /**
+     * @brief Odwraca przekształcenie
+     *
+     * @param[in,out] block - przekształcony blok bajtów
+     * @param parameter - parametr zwrócony przez forward
+     * @throw std::logic_error - jeżeli parametr nie pasuje do bloku
+     */
+    virtual void inverse(std::vector<uint8_t> &block,
+                         uint32_t parameter) const = 0;
+};
+
+/**
+ * @brief Transformata Burrowsa-Wheelera liczona z tablicy sufiksów. Grupuje
+ * bajty występujące w podobnym kontekście, parametrem jest pozycja końca
+ * bloku w ostatniej kolumnie
+ */
+class bwt_transform : public block_transform
+{
+  public:
+    uint8_t parameter_bits() const override { return 32; }
+    uint32_t forward(std::vector<uint8_t> &block) const override;
+    void inverse(std::vector<uint8_t> &block,
+                 uint32_t parameter) const override;
+};
+
+/**
+ * @brief Move-to-front, zamienia bajty na ich pozycję na liście ostatnio
+ * użytych bajtów. Po BWT większość bloku staje się zerami
+ */
+class mtf_transform : public block_transform
+{
+  public:
+    uint8_t parameter_bits() const override { return 0; }
+    uint32_t forward(std::vector<uint8_t> &block) const override;
+    void inverse(std::vector<uint8_t> &block,
+                 uint32_t parameter) const override;
+};
@@ -0,0 +1,70 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "huffman_tree.h"
+
+/**
+ * @brief Kanoniczny kod prefiksowy opisany wyłącznie długościami kodów. Kody
+ * o tej samej długości są przydzielane kolejnym symbolom w rosnącej
+ * kolejności, więc do odtworzenia kodu wystarczą same długości
+ */
+class canonical_code
+{
+  private:
+    std::vector<uint8_t> lengths_;
+    std::vector<uint64_t> codes_;
+    uint8_t max_length_ = 0;
+
+    void assign_codes();
+
+  public:
+    /**
+     * @brief Największa dopuszczalna długość kodu
+     */
+    static constexpr uint8_t length_limit = 56;
+
+    /**
+     * @brief Buduje optymalny kod z częstotliwości przy pomocy drzewa
+     * Huffmana, a następnie skraca kody dłuższe niż max_length
+     *
+     * @param map - częstotliwości symboli
+     * @param max_length - maksymalna długość kodu, nie większa niż length_limit
+     */
+    canonical_code(const freq_map &map, uint8_t max_length);
+
+    /**
+     * @brief Odtwarza kod z długości kodów, np. odczytanych z nagłówka
+     *
+     * @param lengths - długości kodów, 0 dla nieużywanych symboli
+     * @throw std::logic_error - jeżeli długości nie opisują kodu prefiksowego
+     */
+    explicit canonical_code(std::vector<uint8_t> lengths);
+
+    /**
+     * @brief Zwraca długości kodów
+     * @return const std::vector<uint8_t>& - długość kodu każdego symbolu
+     */
+    const std::vector<uint8_t> &get_lengths() const { return this->lengths_; }
+
+    /**
+     * @brief Zwraca kody wyrównane do prawej
+     * @return const std::vector<uint64_t>& - kod każdego symbolu
+     */
+    const std::vector<uint64_t> &get_codes() const { return this->codes_; }
+
+    /**
+     * @brief Zwraca długość najdłuższego kodu
+     * @return uint8_t - maksymalna długość kodu w bitach
+     */
+    uint8_t get_max_length() const { return this->max_length_; }
+
+    /**
+     * @brief Zwraca liczbę bitów potrzebną do zakodowania symboli
+     *
+     * @param map - częstotliwości symboli
+     * @return uint64_t - liczba bitów
+     */
+    uint64_t encoded_bits(const freq_map &map) const;
+};
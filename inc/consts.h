@@ -16,3 +16,8 @@ static constexpr size_t size_16_mb = 16777216; // 16mb
  * @brief Długość bufora bajtów o rozmiarze 8 mb
  */
 static constexpr size_t size_8_mb = 8388608; // 8mb
+
+/**
+ * @brief Długość bufora bajtów o rozmiarze 1 mb
+ */
+static constexpr size_t size_1_mb = 1048576; // 1mb
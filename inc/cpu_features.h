@@ -0,0 +1,31 @@
+﻿#pragma once
+
+/**
+ * @brief Rozszerzenia procesora wykrywane przy starcie programu (cpuid).
+ * Na innych architekturach niż x86 wszystkie są niedostępne
+ */
+class cpu_features
+{
+  private:
+    bool bmi2_ = false;
+    bool avx2_ = false;
+
+    cpu_features();
+
+  public:
+    /**
+     * @brief Zwraca rozszerzenia wykryte na bieżącym procesorze
+     * @return const cpu_features& - wykryte rozszerzenia
+     */
+    static const cpu_features &get();
+
+    /**
+     * @brief Czy procesor obsługuje BMI2 (shlx/shrx/bzhi/pdep/pext)
+     */
+    bool has_bmi2() const { return this->bmi2_; }
+
+    /**
+     * @brief Czy procesor i system operacyjny obsługują AVX2
+     */
+    bool has_avx2() const { return this->avx2_; }
+};
@@ -0,0 +1,65 @@
+﻿#pragma once
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "raw_file.h"
+
+/**
+ * @brief Sposób dostępu do plików
+ */
+enum class io_mode : uint8_t
+{
+    // std::filebuf
+    STREAM = 0,
+    // file descriptor through raw_file
+    RAW = 1,
+    // raw_file with O_DIRECT
+    DIRECT = 2,
+};
+
+/**
+ * @brief Strumień pliku do odczytu albo zapisu, działający przez std::filebuf
+ * lub bezpośrednio przez deskryptor (raw_file), zależnie od io_mode
+ */
+class file_stream : public std::iostream
+{
+  private:
+    std::string path_;
+    std::unique_ptr<raw_file> raw_;
+    std::unique_ptr<std::streambuf> buffer_;
+
+  public:
+    /**
+     * @brief Otwiera plik, przy niepowodzeniu ustawia failbit
+     *
+     * @param path - ścieżka do pliku
+     * @param write - true tworzy lub nadpisuje plik do zapisu, false otwiera
+     * go do odczytu
+     * @param mode - sposób dostępu do pliku
+     */
+    file_stream(const std::string &path, bool write,
+                io_mode mode = io_mode::STREAM);
+
+    /**
+     * @brief Zwraca plik otwarty przez deskryptor
+     * @return raw_file* - plik lub nullptr dla io_mode::STREAM
+     */
+    raw_file *raw() { return this->raw_.get(); }
+
+    /**
+     * @brief Rezerwuje miejsce na dysku dla zapisywanego pliku, bez zmiany
+     * jego rozmiaru
+     *
+     * @param size - przewidywany rozmiar pliku
+     * @return true - jeżeli miejsce zostało zarezerwowane
+     */
+    bool preallocate(uint64_t size);
+
+    /**
+     * @brief Zapisuje bufor i zamyka plik
+     */
+    void close();
+};
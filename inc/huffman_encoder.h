@@ -3,7 +3,11 @@
 #include <cstdint>
 #include <string>
 
+#include "block_codec.h"
 #include "consts.h"
+#include "file_stream.h"
+#include "huffman_stats.h"
+#include "huffman_tree.h"
 #include "ui.h"
 
 /**
@@ -19,6 +23,21 @@ class huffman_encoder
     const size_t buffer_size_;
     size_t buffer_cnt_ = 0;
 
+    huffman_stats stats_;
+    compression_options options_;
+    io_mode io_mode_ = io_mode::STREAM;
+
+    void remove_output(file_stream &output_file) const;
+    bool cancelled(uint64_t processed, uint64_t total,
+                   file_stream &output_file) const;
+    bool count_frequency(file_stream &input_file, freq_map &map,
+                         uint64_t &progress, uint64_t progress_total);
+    void sample_frequency(file_stream &input_file, uint64_t input_size,
+                          freq_map &map);
+    bool compress_blocks(file_stream &input_file, file_stream &output_file);
+    bool decompress_blocks(file_stream &input_file, file_stream &output_file,
+                           block_pipeline pipeline, uint64_t original_size);
+
   public:
 	/**
 	 * @brief Tworzy nowy obiekt encodera
@@ -40,4 +59,47 @@ class huffman_encoder
 	 * @brief Funkcja dekompresująca plik
 	 */
     void decompress_file();
+
+	/**
+	 * @brief Liczy częstotliwość bajtów i długości kodów bez zapisywania pliku
+	 * wyjściowego. Wynik (dokładny rozmiar po kompresji w formacie z jedną
+	 * tablicą kodów, entropia, długości kodów) jest wypisywany przez ui i
+	 * dostępny w get_stats()
+	 */
+    void analyze_file();
+
+	/**
+	 * @brief Ustawia opcje kompresji. Opcje inne niż domyślne powodują zapis
+	 * w formacie blokowym, dekompresja rozpoznaje format sama
+	 *
+	 * @param options - opcje kompresji
+	 */
+    void set_options(const compression_options &options)
+    {
+        this->options_ = options;
+    }
+
+	/**
+	 * @brief Zmienia pliki kolejnej operacji, bufor encodera jest zachowany
+	 *
+	 * @param input_file - ścieżka do pliku wejściowego
+	 * @param output_file - ścieżka do pliku wyjściowego
+	 */
+    void set_files(std::string input_file, std::string output_file)
+    {
+        this->input_file_ = std::move(input_file);
+        this->output_file_ = std::move(output_file);
+    }
+
+	/**
+	 * @brief Ustawia sposób dostępu do plików wejściowego i wyjściowego
+	 *
+	 * @param mode - sposób dostępu do plików
+	 */
+    void set_io_mode(const io_mode mode) { this->io_mode_ = mode; }
+
+	/**
+	 * @brief Zwraca statystyki ostatniej kompresji lub dekompresji
+	 */
+    const huffman_stats &get_stats() const { return this->stats_; }
 };
@@ -0,0 +1,110 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <iostream>
+
+#include "bit_file_io.h"
+#include "block_codec.h"
+#include "huffman_tree.h"
+
+/**
+ * @brief Liczy ile bitów zerowych trzeba wypisać przed kodem, aby długość
+ * kodu wraz z dopełnieniem była wielokrotnością 8
+ *
+ * @param map - częstotliwości bajtów
+ * @param tree - drzewo Huffmana zbudowane z map
+ * @return uint8_t - liczba bitów dopełnienia
+ */
+uint8_t code_padding(const freq_map &map, const huffman_tree &tree);
+
+/**
+ * @brief Zapisuje nagłówek pliku: liczbę unikatowych bajtów, dopełnienie,
+ * częstotliwości bajtów oraz bity dopełnienia
+ *
+ * @param map - częstotliwości bajtów
+ * @param padding - liczba bitów dopełnienia
+ * @param output_file - strumień wyjściowy
+ * @param wrapper - wyjście bitowe strumienia output_file
+ */
+void write_file_header(const freq_map &map, uint8_t padding,
+                       std::iostream &output_file, bit_file_io &wrapper);
+
+/**
+ * @brief Odczytuje i sprawdza nagłówek pliku, a następnie buduje z niego
+ * drzewo Huffmana
+ *
+ * @param file - strumień wejściowy
+ * @param wrapper - wejście bitowe strumienia file
+ * @param[out] map - odczytane częstotliwości bajtów
+ * @return huffman_tree* - drzewo Huffmana, zwalniane przez wywołującego
+ * @throw std::logic_error - jeżeli nagłówek jest obcięty lub niepoprawny
+ */
+huffman_tree *read_file_header(std::iostream &file, bit_file_io &wrapper,
+                               freq_map &map);
+
+/**
+ * @brief Rozmiar danych przed kompresją nieznany z nagłówka (wersja 1
+ * formatu blokowego)
+ */
+constexpr uint64_t unknown_size = UINT64_MAX;
+
+/**
+ * @brief Zapisuje nagłówek formatu blokowego: sygnaturę, wersję, sposób
+ * przetwarzania bloków i rozmiar danych przed kompresją. Sygnatura nie może
+ * być początkiem pliku w starym formacie, bo tam drugi bajt (dopełnienie)
+ * jest mniejszy niż 8
+ *
+ * @param output_file - strumień wyjściowy
+ * @param pipeline - przetwarzanie bloków
+ * @param original_size - suma rozmiarów bloków przed kodowaniem
+ */
+void write_container_header(std::ostream &output_file,
+                            block_pipeline pipeline, uint64_t original_size);
+
+/**
+ * @brief Poprawia rozmiar danych przed kompresją w zapisanym nagłówku, np.
+ * gdy plik wejściowy zmienił się w trakcie kompresji. Pozycja strumienia
+ * nie zmienia się
+ *
+ * @param output_file - strumień wyjściowy z zapisanym nagłówkiem
+ * @param original_size - suma rozmiarów bloków przed kodowaniem
+ */
+void update_original_size(std::ostream &output_file, uint64_t original_size);
+
+/**
+ * @brief Odczytuje nagłówek formatu blokowego. Jeżeli plik jest w starym
+ * formacie, strumień jest cofany na początek
+ *
+ * @param file - strumień wejściowy ustawiony na początku pliku
+ * @param[out] pipeline - przetwarzanie bloków
+ * @param[out] original_size - rozmiar danych przed kompresją lub
+ * unknown_size
+ * @return true - jeżeli plik jest w formacie blokowym
+ * @return false - jeżeli plik jest w starym formacie
+ * @throw std::logic_error - jeżeli wersja lub przetwarzanie są nieznane
+ */
+bool read_container_header(std::istream &file, block_pipeline &pipeline,
+                           uint64_t &original_size);
+
+/**
+ * @brief Zapisuje nagłówek bloku, liczby są zapisywane jako little endian
+ *
+ * @param output_file - strumień wyjściowy
+ * @param type - typ bloku
+ * @param size - rozmiar bloku przed kodowaniem, 0 dla tablic kodów
+ * @param payload_size - rozmiar zakodowanego bloku
+ */
+void write_block_header(std::ostream &output_file, block_type type,
+                        uint32_t size, uint32_t payload_size);
+
+/**
+ * @brief Odczytuje nagłówek bloku
+ *
+ * @param file - strumień wejściowy
+ * @param[out] size - rozmiar bloku przed kodowaniem
+ * @param[out] payload_size - rozmiar zakodowanego bloku
+ * @return block_type - typ bloku, dla block_type::END rozmiary są zerowe
+ * @throw std::logic_error - jeżeli nagłówek jest obcięty lub niepoprawny
+ */
+block_type read_block_header(std::istream &file, uint32_t &size,
+                             uint32_t &payload_size);
@@ -0,0 +1,229 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "bit_file_io.h"
+#include "canonical_code.h"
+#include "huffman_tree.h"
+
+/**
+ * @brief Kod symbolu lub pary bajtów w tablicach kodowania, wyrównany do
+ * prawej
+ */
+struct alignas(8) huffman_encode_entry
+{
+    uint32_t code;
+    uint8_t length;
+};
+
+/**
+ * @brief Tablice kodów używane przez pętle kodujące i dekodujące
+ */
+struct huffman_code_tables
+{
+    // code_bits[x] -> huffman code for symbol x, aligned to the right
+    std::vector<uint64_t> code_bits;
+    std::vector<uint8_t> code_length;
+
+    // code_bits and code_length of bytes packed in one 2 KB block, so the
+    // byte encode loops touch 32 cache lines. Filled for codes up to 16 bits
+    alignas(64) huffman_encode_entry byte_codes[UINT8_MAX + 1]{};
+    // pair_codes[a | b << 8] -> code of byte a followed by code of byte b,
+    // built by huffman_kernels::enable_pair_codes
+    std::vector<huffman_encode_entry> pair_codes;
+
+    // decode_table[bits] -> (code length << 8) | byte for byte alphabets,
+    // wide_decode_table[bits] -> (code length << 16) | symbol for larger
+    // ones. 0 when no code is a prefix of bits
+    std::vector<uint16_t> decode_table;
+    std::vector<uint32_t> wide_decode_table;
+
+    // used by the general kernels for codes of any length, either the tree
+    // or the canonical code (first code of each length and index of its
+    // symbol in sorted_symbols)
+    const std::vector<uint8_t> *codes = nullptr;
+    const huffman_node *root = nullptr;
+    std::vector<uint64_t> first_code;
+    std::vector<uint32_t> first_index;
+    std::vector<uint32_t> length_count;
+    std::vector<uint16_t> sorted_symbols;
+};
+
+/**
+ * @brief Kodowanie i dekodowanie bloków bajtów kodem Huffmana. Pętle są
+ * specjalizowane w czasie kompilacji dla klasy maksymalnej długości kodu oraz
+ * zestawu instrukcji, a odpowiednia specjalizacja jest wybierana raz, po
+ * zbudowaniu drzewa. Alfabety większe niż bajty są kodowane przez wersje
+ * pętli dla symboli 16-bitowych
+ */
+class huffman_kernels
+{
+  public:
+    /**
+     * @brief Klasa maksymalnej długości kodu
+     */
+    enum class length_class : uint8_t
+    {
+        UP_TO_8,
+        UP_TO_12,
+        UP_TO_16,
+        GENERAL,
+    };
+
+    /**
+     * @brief Zestaw instrukcji, dla którego skompilowano pętle
+     */
+    enum class instruction_set : uint8_t
+    {
+        SCALAR,
+        BMI2_AVX2,
+    };
+
+  private:
+    using encode_fn = void (*)(const huffman_code_tables &, const uint8_t *,
+                               size_t, bit_file_io &);
+    using decode_fn = void (*)(const huffman_code_tables &, bit_file_io &,
+                               uint8_t *, size_t);
+    using encode_symbols_fn = void (*)(const huffman_code_tables &,
+                                       const uint16_t *, size_t, bit_file_io &);
+    using decode_symbols_fn = void (*)(const huffman_code_tables &,
+                                       bit_file_io &, uint16_t *, size_t);
+
+    huffman_code_tables tables_;
+    length_class length_class_ = length_class::UP_TO_8;
+    instruction_set instruction_set_;
+    encode_fn encode_ = nullptr;
+    decode_fn decode_ = nullptr;
+    encode_symbols_fn encode_symbols_ = nullptr;
+    decode_symbols_fn decode_symbols_ = nullptr;
+
+    void select_kernels(uint16_t max_length, length_class min_class);
+
+  public:
+    /**
+     * @brief Przygotowuje tablice kodów i wybiera specjalizację pętli
+     *
+     * @param tree - drzewo Huffmana
+     * @param isa - zestaw instrukcji, domyślnie najlepszy dostępny
+     * @param min_class - najwęższa dopuszczalna klasa długości kodu. Wybierana
+     * jest szersza z min_class i klasy wynikającej z drzewa
+     */
+    explicit huffman_kernels(const huffman_tree &tree,
+                             instruction_set isa = best_instruction_set(),
+                             length_class min_class = length_class::UP_TO_8);
+
+    /**
+     * @brief Przygotowuje tablice kodów kanonicznych i wybiera specjalizację
+     * pętli. Kod musi istnieć przez cały czas życia obiektu
+     *
+     * @param code - kod kanoniczny
+     * @param isa - zestaw instrukcji, domyślnie najlepszy dostępny
+     * @param min_class - najwęższa dopuszczalna klasa długości kodu
+     */
+    explicit huffman_kernels(const canonical_code &code,
+                             instruction_set isa = best_instruction_set(),
+                             length_class min_class = length_class::UP_TO_8);
+
+    /**
+     * @brief Najmniejszy rozmiar danych, dla którego opłaca się
+     * enable_pair_codes. Budowa tablicy par trwa mniej więcej tyle, co
+     * kodowanie 40 KB, a kodowanie parami jest szybsze o 5-15%
+     */
+    static constexpr size_t pair_codes_min_size = 524288;
+
+    /**
+     * @brief Buduje tablicę kodów par bajtów (65536 wpisów, 512 KB) i
+     * przełącza encode na pętlę, która koduje dwa bajty jednym odczytem
+     * tablicy. Opłaca się tylko dla danych wielokrotnie większych od
+     * tablicy. Dostępne dla bajtów z kodami do 12 bitów
+     *
+     * @return true - jeżeli encode używa tablicy par
+     */
+    bool enable_pair_codes();
+
+    /**
+     * @brief Zwraca najlepszy zestaw instrukcji obsługiwany przez procesor
+     * @return instruction_set - zestaw instrukcji
+     */
+    static instruction_set best_instruction_set();
+
+    /**
+     * @brief Zlicza wystąpienia bajtów w bloku
+     *
+     * @param data - blok bajtów
+     * @param size - rozmiar bloku
+     * @param[in,out] map - częstotliwości, do których dodawane są wystąpienia
+     * @param isa - zestaw instrukcji, domyślnie najlepszy dostępny
+     */
+    static void count_bytes(const uint8_t *data, size_t size, freq_map &map,
+                            instruction_set isa = best_instruction_set());
+
+    /**
+     * @brief Zwraca wybraną klasę długości kodu
+     * @return length_class - klasa długości kodu
+     */
+    length_class get_length_class() const { return this->length_class_; }
+
+    /**
+     * @brief Zwraca wybrany zestaw instrukcji
+     * @return instruction_set - zestaw instrukcji
+     */
+    instruction_set get_instruction_set() const
+    {
+        return this->instruction_set_;
+    }
+
+    /**
+     * @brief Sprawdza, czy alfabet jest większy niż bajty. Bloki symboli
+     * takiego alfabetu są kodowane przez encode_symbols i decode_symbols,
+     * pozostałe przez encode i decode
+     * @return true - jeżeli alfabet ma więcej niż 256 symboli
+     */
+    bool is_wide() const { return this->tables_.code_length.size() > 256; }
+
+    /**
+     * @brief Koduje blok bajtów
+     *
+     * @param data - blok bajtów
+     * @param size - rozmiar bloku
+     * @param out - wyjście bitowe
+     */
+    void encode(const uint8_t *data, const size_t size, bit_file_io &out) const
+    {
+        this->encode_(this->tables_, data, size, out);
+    }
+
+    /**
+     * @brief Dekoduje dokładnie count bajtów
+     *
+     * @param in - wejście bitowe
+     * @param[out] out - bufor na zdekodowane bajty
+     * @param count - liczba bajtów do zdekodowania
+     * @throw std::logic_error - jeżeli dane są obcięte lub uszkodzone
+     */
+    void decode(bit_file_io &in, uint8_t *out, size_t count) const;
+
+    /**
+     * @brief Koduje blok symboli alfabetu większego niż bajty
+     *
+     * @param data - blok symboli
+     * @param size - liczba symboli
+     * @param out - wyjście bitowe
+     */
+    void encode_symbols(const uint16_t *data, const size_t size,
+                        bit_file_io &out) const
+    {
+        this->encode_symbols_(this->tables_, data, size, out);
+    }
+
+    /**
+     * @brief Dekoduje dokładnie count symboli alfabetu większego niż bajty
+     *
+     * @param in - wejście bitowe
+     * @param[out] out - bufor na zdekodowane symbole
+     * @param count - liczba symboli do zdekodowania
+     * @throw std::logic_error - jeżeli dane są obcięte lub uszkodzone
+     */
+    void decode_symbols(bit_file_io &in, uint16_t *out, size_t count) const;
+};
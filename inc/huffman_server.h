@@ -0,0 +1,124 @@
+﻿#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "file_stream.h"
+#include "ui.h"
+
+/**
+ * @brief Statystyki serwera od jego uruchomienia. Percentyle opóźnień są
+ * liczone z ostatnich server_stats::latency_samples żądań, w milisekundach
+ */
+struct server_stats
+{
+    static constexpr size_t latency_samples = 65536;
+
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+
+    double p50_ms = 0;
+    double p90_ms = 0;
+    double p99_ms = 0;
+    double max_ms = 0;
+
+    /**
+     * @brief Serializuje statystyki do jednolinijkowego JSON-a
+     * @return std::string - statystyki w formacie JSON
+     */
+    std::string to_json() const;
+};
+
+/**
+ * @brief Serwer kompresji nasłuchujący na gnieździe domeny UNIX. Połączenia
+ * są obsługiwane równolegle przez stałą pulę wątków, każdy wątek ma własny
+ * encoder z buforem i zapamiętuje ostatnią tablicę kodów, więc kolejne
+ * żądania nie budują jej od nowa. Żądanie to jedna linia tekstu, po której
+ * mogą następować dane:
+ *
+ * COMPRESS <poziom> <rozmiar>\n<dane>
+ * DECOMPRESS <rozmiar>\n<dane>
+ * COMPRESS_FILE <poziom>\n<plik wejściowy>\n<plik wyjściowy>\n
+ * DECOMPRESS_FILE\n<plik wejściowy>\n<plik wyjściowy>\n
+ * STATS\n
+ * SHUTDOWN\n
+ *
+ * Połączenie czekające na kolejne żądanie nie zajmuje wątku, a połączenie,
+ * które przestaje przesyłać żądanie lub odbierać odpowiedź, jest zamykane po
+ * limicie czasu.
+ *
+ * Odpowiedź to "OK <rozmiar>\n<dane>" albo "ERROR <komunikat>\n". Dla
+ * żądań plikowych danymi są statystyki operacji, a dla STATS statystyki
+ * serwera, oba w formacie JSON. Poza systemami POSIX serwer nie jest
+ * dostępny
+ */
+class huffman_server
+{
+  private:
+    struct worker;
+
+    const std::string socket_path_;
+    const ui &ui_;
+    const unsigned threads_;
+    const io_mode io_mode_;
+
+    int listen_fd_ = -1;
+    // pipe waking run() when idle_ changes or the server stops
+    int wake_fds_[2] = {-1, -1};
+    std::atomic<bool> stopping_{false};
+
+    std::mutex queue_mutex_;
+    std::condition_variable queue_ready_;
+    // connections with a request to read
+    std::deque<int> connections_;
+    // connections served by workers, shut down by stop()
+    std::vector<int> active_;
+    // connections waiting for a request, polled by run()
+    std::vector<int> idle_;
+
+    mutable std::mutex stats_mutex_;
+    server_stats stats_;
+    // ring of the last server_stats::latency_samples latencies in seconds
+    std::vector<double> latencies_;
+
+    void serve(worker &state);
+    bool serve_connection(int fd, worker &state);
+    bool handle_request(worker &state);
+    void record(double seconds, bool ok, uint64_t bytes_in,
+                uint64_t bytes_out);
+    void wake();
+    void stop();
+
+  public:
+    /**
+     * @brief Tworzy serwer, gniazdo jest tworzone dopiero przez run()
+     *
+     * @param socket_path - ścieżka gniazda, istniejący plik jest zastępowany
+     * @param ui - interfejs użytkownika dla błędów samego serwera
+     * @param threads - liczba wątków obsługujących połączenia, 0 oznacza
+     * liczbę wątków sprzętowych
+     * @param mode - sposób dostępu do plików żądań plikowych
+     */
+    huffman_server(std::string socket_path, const ui &ui, unsigned threads,
+                   io_mode mode = io_mode::STREAM);
+    ~huffman_server();
+    huffman_server(const huffman_server &) = delete;
+    huffman_server &operator=(const huffman_server &) = delete;
+
+    /**
+     * @brief Nasłuchuje i obsługuje połączenia do żądania SHUTDOWN
+     */
+    void run();
+
+    /**
+     * @brief Zwraca statystyki serwera z percentylami opóźnień żądań
+     */
+    server_stats get_stats() const;
+};
@@ -0,0 +1,73 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "huffman_tree.h"
+
+/**
+ * @brief Statystyki ostatniej kompresji lub dekompresji. Czasy faz podane są w
+ * sekundach, rozmiary w bajtach
+ */
+struct huffman_stats
+{
+    // "compress", "decompress" or "analyze"
+    std::string operation;
+
+    double histogram_seconds = 0;
+    double tree_build_seconds = 0;
+    double header_seconds = 0;
+    double transform_seconds = 0;
+    double flush_seconds = 0;
+    double total_seconds = 0;
+
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    uint64_t original_size = 0;
+    uint64_t compressed_size = 0;
+
+    // bits per byte of the original data
+    double average_code_length = 0;
+    double entropy = 0;
+
+    // huffman code bits of the whole data, without header and padding
+    uint64_t encoded_bits = 0;
+    // code_lengths[x] -> code length of byte x, 0 when byte doesn't occur
+    uint8_t code_lengths[UINT8_MAX + 1]{};
+
+    // fields that weren't measured are left out of to_json, blocks build
+    // their histograms and codes inside the transform phase
+    bool histogram_measured = false;
+    // entropy, code_lengths and the tree_build phase
+    bool code_stats_measured = false;
+    // encoded_bits and average_code_length
+    bool encoded_bits_measured = false;
+
+    /**
+     * @brief Liczy długości kodów, średnią długość kodu oraz entropię Shannona
+     * i oznacza je jako zmierzone
+     *
+     * @param map - częstotliwości bajtów
+     * @param tree - drzewo Huffmana zbudowane z map
+     */
+    void set_code_stats(const freq_map &map, const huffman_tree &tree);
+
+    /**
+     * @brief Zwraca stosunek rozmiaru oryginalnego do skompresowanego
+     * @return double - współczynnik kompresji
+     */
+    double compression_ratio() const;
+
+    /**
+     * @brief Zwraca przepustowość w MB/s (1 MB = 10^6 bajtów) liczoną po
+     * rozmiarze oryginalnym
+     * @return double - przepustowość
+     */
+    double throughput_mb_s() const;
+
+    /**
+     * @brief Serializuje statystyki do jednolinijkowego JSON-a
+     * @return std::string - statystyki w formacie JSON
+     */
+    std::string to_json() const;
+};
@@ -1,10 +1,12 @@
 ﻿#pragma once
+#include <cstddef>
 #include <cstdint>
 #include <unordered_map>
 #include <vector>
 
 /**
- * @brief Klasa pomocnicza do przechowywania częstotliwości wystepowania bajtów
+ * @brief Klasa pomocnicza do przechowywania częstotliwości wystepowania bajtów.
+ * Może też przechowywać częstotliwości symboli alfabetu większego niż bajty
  */
 class freq_map
 {
@@ -12,7 +14,21 @@ class freq_map
     std::vector<uint64_t> freq_;
 
   public:
-    freq_map() : freq_(std::vector<uint64_t>(UINT8_MAX + 1, 0)) {}
+    /**
+     * @brief Tworzy pustą mapę częstotliwości
+     *
+     * @param alphabet_size - liczba symboli, domyślnie wszystkie bajty
+     */
+    explicit freq_map(const size_t alphabet_size = UINT8_MAX + 1)
+        : freq_(std::vector<uint64_t>(alphabet_size, 0))
+    {
+    }
+
+    /**
+     * @brief Zwraca liczbę symboli alfabetu
+     * @return size_t - rozmiar alfabetu
+     */
+    size_t alphabet_size() const { return freq_.size(); }
 
     /**
      * @brief Pobiera ilość występowania danego bajtu
@@ -20,7 +36,7 @@ class freq_map
      * @param byte bajt
      * @return uint64_t częstotliwość bajtu byte
      */
-    uint64_t get(uint8_t byte) const { return freq_[byte]; }
+    uint64_t get(uint16_t byte) const { return freq_[byte]; }
 
     /**
      * @brief Ustawia ilość wystepowania danego bajtu na podaną wartość
@@ -28,14 +44,26 @@ class freq_map
      * @param byte bajt
      * @param value nowa ilość
      */
-    void set(uint8_t byte, uint64_t value) { freq_[byte] = value; }
+    void set(uint16_t byte, uint64_t value) { freq_[byte] = value; }
 
     /**
      * @brief Inkrementuje częstotliwość danego bajtu
      *
      * @param byte byte
      */
-    void inc(uint8_t byte) { ++freq_[byte]; }
+    void inc(uint16_t byte) { ++freq_[byte]; }
+
+    /**
+     * @brief Zwraca sumę częstotliwości wszystkich bajtów
+     * @return uint64_t - liczba wszystkich bajtów
+     */
+    uint64_t total() const
+    {
+        uint64_t sum = 0;
+        for (const uint64_t freq : freq_)
+            sum += freq;
+        return sum;
+    }
 
     /**
      * @brief Zwraca ilość unikatowych bajtów
@@ -44,7 +72,7 @@ class freq_map
     uint16_t size() const
     {
         uint16_t cnt = 0;
-        for (uint16_t i = 0; i <= UINT8_MAX; i++)
+        for (size_t i = 0; i < freq_.size(); i++)
             if (freq_[i])
                 cnt++;
         return cnt;
@@ -94,19 +122,19 @@ class huffman_node
 class huffman_leaf : public huffman_node
 {
   private:
-    uint8_t value_ = 0;
+    uint16_t value_ = 0;
 
   public:
-    huffman_leaf(const uint64_t frequency, const uint8_t value)
+    huffman_leaf(const uint64_t frequency, const uint16_t value)
         : huffman_node(frequency, nullptr, nullptr), value_(value)
     {
     }
 
     /**
-     * @brief Zwraca bajt reprezentowany przez liść
-     * @return uint8_t - bajt reprezentowany przez liść
+     * @brief Zwraca bajt (symbol) reprezentowany przez liść
+     * @return uint16_t - bajt reprezentowany przez liść
      */
-    uint8_t get_value() const { return this->value_; }
+    uint16_t get_value() const { return this->value_; }
 };
 
 /**
@@ -118,6 +146,9 @@ class huffman_tree
     huffman_node *tree_root_ = nullptr;
     const freq_map &chars_freq_;
     std::vector<uint8_t> *codes_;
+    uint16_t max_code_length_ = 0;
+    // node reached by try_get_byte so far
+    mutable const huffman_node *current_node_ = nullptr;
     void fill_codes(huffman_node *root, std::vector<uint8_t> current);
 
   public:
@@ -138,7 +169,21 @@ class huffman_tree
     const std::vector<uint8_t> *get_codes() const { return this->codes_; }
 
     /**
-     * @brief Przy użyciu statycznego bufora próbuje odczytać bajt z podanego
+     * @brief Zwraca długość najdłuższego kodu
+     *
+     * @return uint16_t - maksymalna długość kodu w bitach
+     */
+    uint16_t get_max_code_length() const { return this->max_code_length_; }
+
+    /**
+     * @brief Zwraca korzeń drzewa
+     *
+     * @return const huffman_node* - korzeń drzewa
+     */
+    const huffman_node *get_root() const { return this->tree_root_; }
+
+    /**
+     * @brief Przy użyciu wewnętrznego bufora próbuje odczytać bajt z podanego
      * kodu. Jeżeli kod nie jest jeszcze jednoznaczny funkcja dopisuje bit do
      * bufora i zwraca false. W przeciwnym wypadku czyściu bufor, ustawia byte
      * na odpowiedni bajt i zwraca true
@@ -147,6 +192,7 @@ class huffman_tree
      * @param code_bit bit kodu
      * @return true - jeżeli bajt został odczytany
      * @return false - jeżeli kod jest jeszcze niejednoznaczny
+     * @throw std::logic_error - jeżeli żaden bajt nie ma takiego kodu
      */
     bool try_get_byte(uint8_t &byte, uint8_t code_bit) const;
 };
@@ -0,0 +1,100 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "huffman_kernels.h"
+#include "ui.h"
+
+/**
+ * @brief Różnicowe testowanie kodowania i dekodowania. Każde dane są
+ * przepuszczane przez wszystkie dostępne ścieżki (referencyjną bit po bicie
+ * oraz każdą specjalizację huffman_kernels dla każdego zestawu instrukcji
+ * obsługiwanego przez procesor), a wyniki porównywane. Odczyt niezaufanych
+ * danych skompresowanych musi kończyć się błędem albo tym samym wynikiem na
+ * każdej ścieżce. Kontenery bloków są dekodowane przez huffman_encoder z
+ * plików tymczasowych, przez strumień i deskryptor, jednym i wieloma wątkami
+ */
+class huffman_verifier
+{
+  private:
+    const ui &ui_;
+    std::vector<huffman_kernels::instruction_set> instruction_sets_;
+
+    bool report(const std::string &error) const;
+    bool verify_container(const std::string &compressed,
+                          const std::string *expected) const;
+
+  public:
+    /**
+     * @brief Liczba wariantów kontenera bloków: każdy poziom kompresji,
+     * kodowanie długości serii i tablica kodów z próbki
+     */
+    static constexpr int container_variants = 11;
+
+    /**
+     * @brief Tworzy weryfikator
+     * @param ui - implementacja interfejsu użytkownika, przez którą zgłaszane
+     * są rozbieżności
+     */
+    explicit huffman_verifier(const ui &ui);
+
+    /**
+     * @brief Kompresuje dane każdą ścieżką, porównuje wyniki z referencyjnym
+     * i dekoduje je każdą ścieżką
+     *
+     * @param data - dane
+     * @param size - rozmiar danych
+     * @return true - jeżeli wszystkie ścieżki dały ten sam, poprawny wynik
+     */
+    bool verify_data(const uint8_t *data, size_t size) const;
+
+    /**
+     * @brief Traktuje dane jako niezaufany plik skompresowany i dekoduje je
+     * każdą ścieżką
+     *
+     * @param data - dane
+     * @param size - rozmiar danych
+     * @return true - jeżeli wszystkie ścieżki zgłosiły błąd albo dały ten sam
+     * wynik
+     */
+    bool verify_compressed(const uint8_t *data, size_t size) const;
+
+    /**
+     * @brief Kompresuje dane do kontenera bloków jednym z wariantów i
+     * sprawdza, czy każda ścieżka dekodowania go odtwarza. Potem psuje
+     * kontener (nagłówki bloków, tablice kodów, indeks BWT, odległości LZ77)
+     * i sprawdza, czy ścieżki zgadzają się co do wyniku
+     *
+     * @param data - dane
+     * @param size - rozmiar danych
+     * @param variant - wariant od 0 do container_variants - 1
+     * @param seed - ziarno uszkodzeń kontenera
+     * @return true - jeżeli nie wykryto rozbieżności
+     */
+    bool verify_container_variant(const uint8_t *data, size_t size,
+                                  int variant, uint64_t seed) const;
+
+    /**
+     * @brief Wykonuje verify_data, verify_compressed i każdy wariant
+     * verify_container_variant na zawartości pliku.
+     * Nadaje się do uruchamiania przez fuzzery plikowe (np. AFL), program
+     * przerywa się wtedy przez abort() przy rozbieżności
+     *
+     * @param path - ścieżka do pliku
+     * @return true - jeżeli nie wykryto rozbieżności
+     */
+    bool verify_file(const std::string &path) const;
+
+    /**
+     * @brief Generuje losowe i złośliwe dane (w tym drzewa z kodami dłuższymi
+     * niż mieszczą się w akumulatorze) i weryfikuje je, każdy przypadek także
+     * w losowym wariancie kontenera bloków
+     *
+     * @param seed - ziarno generatora
+     * @param iterations - liczba przypadków
+     * @return true - jeżeli nie wykryto rozbieżności
+     */
+    bool verify_random(uint64_t seed, size_t iterations) const;
+};
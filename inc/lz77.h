@@ -0,0 +1,92 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bit_file_io.h"
+
+/**
+ * @brief Najkrótsze i najdłuższe kodowane dopasowanie
+ */
+static constexpr size_t lz77_min_match = 3;
+static constexpr size_t lz77_max_match = 258;
+
+/**
+ * @brief Rozmiar okna, największa odległość dopasowania to lz77_window - 1
+ */
+static constexpr size_t lz77_window = 65536;
+
+/**
+ * @brief Liczba symboli alfabetu literałów i długości: bajty oraz 28 kodów
+ * długości
+ */
+static constexpr size_t lz77_literal_alphabet_size = 256 + 28;
+
+/**
+ * @brief Liczba symboli alfabetu odległości
+ */
+static constexpr size_t lz77_distance_alphabet_size = 32;
+
+/**
+ * @brief Parametry wyszukiwania dopasowań
+ */
+struct lz77_params
+{
+    // candidates checked for every position, more gives longer matches
+    size_t max_chain = 32;
+    // match long enough to stop searching
+    size_t nice_length = lz77_max_match;
+    // a match is coded one byte later when that position has a better one
+    bool lazy = false;
+};
+
+/**
+ * @brief Blok po wyszukaniu dopasowań. Kody długości i odległości są
+ * przedziałami, dokładną wartość wskazują bity dodatkowe
+ */
+struct lz77_block
+{
+    // bytes and length codes (256 + code)
+    std::vector<uint16_t> literals;
+    // distance code of every length code
+    std::vector<uint8_t> distances;
+    // (value << 8) | bit count, for every match length then distance
+    std::vector<uint32_t> extra_bits;
+};
+
+/**
+ * @brief Szuka powtórzeń w bloku przy pomocy łańcuchów haszy trzech bajtów
+ *
+ * @param data - blok bajtów
+ * @param size - rozmiar bloku
+ * @param params - parametry wyszukiwania
+ * @param[out] block - literały, dopasowania i bity dodatkowe
+ */
+void lz77_encode(const uint8_t *data, size_t size, const lz77_params &params,
+                 lz77_block &block);
+
+/**
+ * @brief Odtwarza blok z literałów i dopasowań, bity dodatkowe są czytane z
+ * wejścia w kolejności dopasowań
+ *
+ * @param literals - literały i kody długości
+ * @param count - liczba literałów i kodów długości
+ * @param distances - kody odległości, po jednym na kod długości
+ * @param in - wejście bitowe z bitami dodatkowymi
+ * @param[out] out - bufor na bajty
+ * @param size - oczekiwany rozmiar bloku
+ * @throw std::logic_error - jeżeli dane nie opisują bloku o rozmiarze size
+ */
+void lz77_decode(const uint16_t *literals, size_t count,
+                 const uint8_t *distances, bit_file_io &in, uint8_t *out,
+                 size_t size);
+
+/**
+ * @brief Zwraca liczbę kodów długości w literałach
+ *
+ * @param literals - literały i kody długości
+ * @param count - liczba literałów i kodów długości
+ * @return size_t - liczba dopasowań
+ */
+size_t lz77_match_count(const uint16_t *literals, size_t count);
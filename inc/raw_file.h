@@ -0,0 +1,183 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <streambuf>
+#include <string>
+
+/**
+ * @brief Plik otwarty bezpośrednio przez deskryptor systemu, bez buforów
+ * biblioteki standardowej. Odczyt jest sekwencyjny, zapis może pomijać
+ * pamięć podręczną systemu (O_DIRECT), a kopiowanie między plikami odbywa
+ * się w jądrze (copy_file_range). Poza Linuksem te optymalizacje są
+ * pomijane
+ */
+class raw_file
+{
+  private:
+    int fd_ = -1;
+    uint64_t position_ = 0;
+    // O_DIRECT was asked for, it's switched on only for aligned transfers
+    bool direct_ = false;
+    bool direct_on_ = false;
+    // errno of the last failed read, 0 when reads only reached the end
+    int error_ = 0;
+
+    void set_direct(bool on);
+
+  public:
+    /**
+     * @brief Wyrównanie adresów, rozmiarów i pozycji wymagane przez O_DIRECT
+     */
+    static constexpr size_t alignment = 4096;
+
+    /**
+     * @brief Otwiera plik
+     *
+     * @param path - ścieżka do pliku
+     * @param write - true tworzy lub nadpisuje plik do zapisu, false otwiera
+     * go do odczytu
+     * @param direct - omija pamięć podręczną systemu przy wyrównanych
+     * odczytach i zapisach
+     */
+    raw_file(const std::string &path, bool write, bool direct = false);
+    ~raw_file();
+    raw_file(const raw_file &) = delete;
+    raw_file &operator=(const raw_file &) = delete;
+
+    /**
+     * @brief Sprawdza, czy plik jest otwarty
+     */
+    bool is_open() const { return this->fd_ >= 0; }
+
+    /**
+     * @brief Sprawdza, czy plik używa O_DIRECT przy wyrównanych transferach
+     */
+    bool direct() const { return this->direct_; }
+
+    /**
+     * @brief Zwraca kod błędu (errno) ostatniego nieudanego odczytu
+     * @return int - kod błędu lub 0, jeżeli odczyty kończyły się tylko na
+     * końcu pliku
+     */
+    int error() const { return this->error_; }
+
+    /**
+     * @brief Zwraca pozycję w pliku
+     */
+    uint64_t position() const { return this->position_; }
+
+    /**
+     * @brief Zwraca rozmiar pliku
+     */
+    uint64_t size() const;
+
+    /**
+     * @brief Czyta bajty od bieżącej pozycji
+     *
+     * @param[out] data - bufor
+     * @param size - liczba bajtów
+     * @return size_t - liczba przeczytanych bajtów, mniejsza od size na
+     * końcu pliku lub przy błędzie, który zwraca wtedy error()
+     */
+    size_t read(void *data, size_t size);
+
+    /**
+     * @brief Zapisuje bajty od bieżącej pozycji
+     *
+     * @param data - bajty
+     * @param size - liczba bajtów
+     * @return true - jeżeli zapisano wszystkie bajty
+     */
+    bool write(const void *data, size_t size);
+
+    /**
+     * @brief Ustawia pozycję w pliku
+     *
+     * @param position - pozycja od początku pliku
+     * @return true - jeżeli się udało
+     */
+    bool seek(uint64_t position);
+
+    /**
+     * @brief Kopiuje bajty od bieżącej pozycji do innego pliku bez
+     * przenoszenia ich przez pamięć programu, o ile system na to pozwala
+     *
+     * @param output - plik docelowy, bajty są zapisywane od jego bieżącej
+     * pozycji
+     * @param size - liczba bajtów
+     * @return uint64_t - liczba skopiowanych bajtów
+     */
+    uint64_t copy_to(raw_file &output, uint64_t size);
+
+    /**
+     * @brief Rezerwuje miejsce na dysku dla size bajtów pliku, bez zmiany
+     * jego rozmiaru. Poza Linuksem nic nie robi
+     *
+     * @param size - przewidywany rozmiar pliku
+     * @return true - jeżeli miejsce zostało zarezerwowane
+     */
+    bool allocate(uint64_t size);
+
+    /**
+     * @brief Rezerwuje miejsce na dysku dla pliku otwartego w inny sposób,
+     * plik jest otwierany ponownie bez obcinania
+     *
+     * @param path - ścieżka do istniejącego pliku
+     * @param size - przewidywany rozmiar pliku
+     * @return true - jeżeli miejsce zostało zarezerwowane
+     */
+    static bool allocate(const std::string &path, uint64_t size);
+
+    /**
+     * @brief Zamyka plik
+     * @return true - jeżeli plik zamknięto bez błędu
+     */
+    bool close();
+};
+
+/**
+ * @brief Bufor strumienia nad raw_file, pozwala używać pliku przez
+ * std::iostream, np. w bit_file_io. Plik jest albo czytany, albo zapisywany.
+ * Błąd odczytu jest zgłaszany wyjątkiem, który strumień zamienia na badbit,
+ * więc nie wygląda jak koniec pliku.
+ * Duże odczyty i zapisy omijają bufor, chyba że plik używa O_DIRECT, który
+ * wymaga wyrównanych transferów. sync() zrównuje pozycję pliku z
+ * pozycją strumienia, więc po nim można kopiować bezpośrednio przez
+ * raw_file::copy_to
+ */
+class raw_file_buf : public std::streambuf
+{
+  private:
+    raw_file &file_;
+    const bool write_;
+    // buffer_ is storage_ aligned to raw_file::alignment
+    char *storage_, *buffer_;
+    const size_t buffer_size_;
+
+    bool flush_put_area();
+    pos_type stream_position() const;
+
+  protected:
+    int_type underflow() override;
+    int_type overflow(int_type ch) override;
+    std::streamsize xsgetn(char *data, std::streamsize count) override;
+    std::streamsize xsputn(const char *data, std::streamsize count) override;
+    pos_type seekoff(off_type offset, std::ios_base::seekdir dir,
+                     std::ios_base::openmode which) override;
+    pos_type seekpos(pos_type position, std::ios_base::openmode which) override;
+    int sync() override;
+
+  public:
+    /**
+     * @brief Tworzy bufor
+     *
+     * @param file - otwarty plik, musi istnieć przez cały czas życia bufora
+     * @param write - true dla pliku zapisywanego
+     * @param buffer_size - rozmiar bufora, wielokrotność raw_file::alignment
+     */
+    raw_file_buf(raw_file &file, bool write, size_t buffer_size);
+    ~raw_file_buf() override;
+    raw_file_buf(const raw_file_buf &) = delete;
+    raw_file_buf &operator=(const raw_file_buf &) = delete;
+};
@@ -0,0 +1,70 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Symbol dopisywany do serii, cyfra 1 długości serii w bijektywnym
+ * systemie dwójkowym
+ */
+static constexpr uint16_t run_a = 256;
+
+/**
+ * @brief Symbol dopisywany do serii, cyfra 2 długości serii w bijektywnym
+ * systemie dwójkowym
+ */
+static constexpr uint16_t run_b = 257;
+
+/**
+ * @brief Liczba symboli alfabetu po kodowaniu serii: bajty, run_a oraz run_b
+ */
+static constexpr size_t run_length_alphabet_size = 258;
+
+/**
+ * @brief Zamienia serie powtarzających się bajtów na bajt oraz długość
+ * powtórzenia zapisaną symbolami run_a i run_b. Seria długości n zajmuje
+ * 1 + log2(n) symboli
+ *
+ * @param data - blok bajtów
+ * @param size - rozmiar bloku
+ * @param[out] symbols - symbole alfabetu o rozmiarze run_length_alphabet_size
+ */
+void run_length_encode(const uint8_t *data, size_t size,
+                       std::vector<uint16_t> &symbols);
+
+/**
+ * @brief Odtwarza blok bajtów z symboli zapisanych przez run_length_encode
+ *
+ * @param symbols - symbole
+ * @param count - liczba symboli
+ * @param[out] out - bufor na bajty
+ * @param size - oczekiwany rozmiar bloku
+ * @throw std::logic_error - jeżeli symbole nie opisują bloku o rozmiarze size
+ */
+void run_length_decode(const uint16_t *symbols, size_t count, uint8_t *out,
+                       size_t size);
+
+/**
+ * @brief Zamienia serie zer na ich długość zapisaną symbolami run_a i run_b,
+ * pozostałe bajty zostają bez zmian. Przeznaczone dla wyjścia move-to-front,
+ * w którym dominują zera
+ *
+ * @param data - blok bajtów
+ * @param size - rozmiar bloku
+ * @param[out] symbols - symbole alfabetu o rozmiarze run_length_alphabet_size
+ */
+void zero_run_encode(const uint8_t *data, size_t size,
+                     std::vector<uint16_t> &symbols);
+
+/**
+ * @brief Odtwarza blok bajtów z symboli zapisanych przez zero_run_encode
+ *
+ * @param symbols - symbole
+ * @param count - liczba symboli
+ * @param[out] out - bufor na bajty
+ * @param size - oczekiwany rozmiar bloku
+ * @throw std::logic_error - jeżeli symbole nie opisują bloku o rozmiarze size
+ */
+void zero_run_decode(const uint16_t *symbols, size_t count, uint8_t *out,
+                     size_t size);
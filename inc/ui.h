@@ -1,4 +1,6 @@
 ﻿#pragma once
+#include <cstdint>
+#include <ostream>
 #include <string>
 
 /**
@@ -19,6 +21,20 @@ class ui
      * @param error_msg - komunikat błędu
      */
     virtual void app_error(const std::string &error_msg) const = 0;
+
+    /**
+     * @brief Raportuje postęp długiej operacji. Wywoływana tylko na granicach
+     * buforów, nie dla każdego bajtu
+     * @param processed - liczba przetworzonych bajtów
+     * @param total - liczba wszystkich bajtów do przetworzenia
+     * @return true - jeżeli operacja ma być kontynuowana
+     * @return false - jeżeli operacja ma zostać przerwana
+     */
+    virtual bool report_progress(uint64_t /*processed*/,
+                                 uint64_t /*total*/) const
+    {
+        return true;
+    }
 };
 
 /**
@@ -27,9 +43,29 @@ class ui
  */
 class console_ui final : public ui
 {
+  private:
+    mutable int last_percent_ = -1;
+    std::ostream *messages_;
+
+    void end_progress_line() const;
+
   public:
     /**
-     * @brief Wyświetla komunikat na stdout
+     * @brief Tworzy konsolowy interfejs. Pierwsze SIGINT przerywa bieżącą
+     * operację przy najbliższym raporcie postępu, kolejne kończy program
+     */
+    console_ui();
+
+    /**
+     * @brief Zmienia strumień komunikatów, np. na stderr, kiedy stdout jest
+     * zarezerwowane dla danych wyjściowych
+     * @param messages - strumień komunikatów
+     */
+    void set_message_stream(std::ostream &messages);
+
+    /**
+     * @brief Wyświetla komunikat na stdout lub na strumień ustawiony przez
+     * set_message_stream()
      * @param msg - komunikat do wyświetlenia
      */
     void write_message(const std::string &msg) const override;
@@ -40,4 +76,12 @@ class console_ui final : public ui
      * @param error_msg - komunikat błędu
      */
     void app_error(const std::string &error_msg) const override;
+
+    /**
+     * @brief Wypisuje procent postępu na stderr, kiedy się zmieni
+     * @param processed - liczba przetworzonych bajtów
+     * @param total - liczba wszystkich bajtów do przetworzenia
+     * @return false - jeżeli użytkownik wcisnął Ctrl+C
+     */
+    bool report_progress(uint64_t processed, uint64_t total) const override;
 };
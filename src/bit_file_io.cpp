@@ -2,48 +2,61 @@
 
 #include <climits>
 
-bit_file_io::bit_file_io(std::fstream &file_stream, size_t read_buff_size,
+bit_file_io::bit_file_io(std::iostream &file_stream, size_t read_buff_size,
                          size_t write_buff_size)
     : file_stream_(file_stream),
       r_buff_size_(std::max(read_buff_size, static_cast<size_t>(1))),
       w_buff_size_(std::max(write_buff_size, static_cast<size_t>(1)))
 {
     r_buff_ = new uint8_t[r_buff_size_];
-    w_buff_ = new uint8_t[w_buff_size_];
+    // w_buff_ has room for one extra word, so flush_bits can always store
+    // whole 8 bytes at once
+    w_buff_ = new uint8_t[w_buff_size_ + sizeof(uint64_t)];
 }
 
 bit_file_io::~bit_file_io()
 {
-    delete r_buff_;
-    delete w_buff_;
+    delete[] r_buff_;
+    delete[] w_buff_;
 }
 
-void bit_file_io::write_bit(uint8_t bit)
+void bit_file_io::write_bit(uint8_t bit) { this->write_bits(bit & 1, 1); }
+
+/**
+ * @brief Moves all full bytes from w_bit_buf_ to w_buff_. If w_buff_ achieves
+ * max size it's being flushed
+ */
+void bit_file_io::flush_bits()
 {
-    bit &= 1;
+    uint8_t *dst = this->w_buff_ + this->w_buff_cnt_;
+    for (size_t i = 0; i < sizeof(uint64_t); i++)
+        dst[i] = static_cast<uint8_t>(this->w_bit_buf_ >>
+                                      ((sizeof(uint64_t) - 1 - i) * CHAR_BIT));
 
-    if (bit)
-        this->w_bit_buf_ |= 1 << ((CHAR_BIT - 1) - this->w_bit_buf_size_);
-    this->w_bit_buf_size_++;
+    const uint8_t bytes = this->w_bit_buf_size_ / CHAR_BIT;
+    this->w_buff_cnt_ += bytes;
+    this->w_bit_buf_ <<= bytes * CHAR_BIT;
+    this->w_bit_buf_size_ -= bytes * CHAR_BIT;
 
-    if (this->w_bit_buf_size_ == CHAR_BIT)
-        flush_bit_buffer();
+    if (this->w_buff_cnt_ >= this->w_buff_size_)
+        flush_buffer();
 }
 
 /**
- * @brief Causes w_bit_buf_ to be saved to w_buff_. If w_buff_ achieves max size
- * it's being flushed
+ * @brief Causes remaining bits of w_bit_buf_ to be saved to w_buff_, padded
+ * with zeros to the full byte. If w_buff_ achieves max size it's being flushed
  */
 void bit_file_io::flush_bit_buffer()
 {
     if (this->w_bit_buf_size_ == 0)
         return;
 
-    this->w_buff_[this->w_buff_cnt_++] = this->w_bit_buf_;
+    this->w_buff_[this->w_buff_cnt_++] =
+        static_cast<uint8_t>(this->w_bit_buf_ >> (64 - CHAR_BIT));
     this->w_bit_buf_size_ = 0;
     this->w_bit_buf_ = 0;
 
-    if (this->w_buff_cnt_ == this->w_buff_size_)
+    if (this->w_buff_cnt_ >= this->w_buff_size_)
         flush_buffer();
 }
 
@@ -61,31 +74,33 @@ void bit_file_io::flush_buffer()
     this->w_buff_cnt_ = 0;
 }
 
+/**
+ * @brief Reads next chunk of file to r_buff_
+ */
+bool bit_file_io::fill_read_buffer()
+{
+    this->file_stream_.read(
+        reinterpret_cast<char *>(this->r_buff_),
+        static_cast<std::streamsize>(sizeof(uint8_t) * this->r_buff_size_));
+    this->r_buff_cnt_ = static_cast<size_t>(this->file_stream_.gcount());
+    this->r_buff_pos_ = 0;
+    return this->r_buff_cnt_ > 0;
+}
+
 /**
  * @brief Reads single bit from file
  */
 bool bit_file_io::read_bit(uint8_t &bit)
 {
-	if (this->r_bit_buf_size_ == 0)
+    if (this->r_bit_buf_size_ <= 0)
     {
-	    static size_t r_buff_pos = 0;
-	    if (r_buff_pos == this->r_buff_cnt_)
-        {
-			this->file_stream_.read(
-				reinterpret_cast<char*>(this->r_buff_),
-				static_cast<std::streamsize>(sizeof(uint8_t) * this->r_buff_size_));
-            this->r_buff_cnt_ = this->file_stream_.gcount();
-			if (this->r_buff_cnt_ == 0) 
-				return false;
-			r_buff_pos = 0;
-        }
-
-        this->r_bit_buf_ = this->r_buff_[r_buff_pos++];
-        this->r_bit_buf_size_ = CHAR_BIT;
+        this->refill();
+        if (this->r_bit_buf_size_ <= 0)
+            return false;
     }
 
-    this->r_bit_buf_size_--;
-    bit = (r_bit_buf_ & (1 << this->r_bit_buf_size_)) >> this->r_bit_buf_size_;
+    bit = static_cast<uint8_t>(this->peek_bits(1));
+    this->skip_bits(1);
     return true;
 }
 
@@ -0,0 +1,492 @@
+﻿#include "../inc/block_codec.h"
+
+#include "../inc/canonical_code.h"
+#include "../inc/huffman_kernels.h"
+#include "../inc/run_length.h"
+#include <algorithm>
+#include <climits>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+// block payload is a bit stream:
+// [symbol count:32][transform parameters][code table][codes][padding]
+// code table is [table size:16][code length:6 x table size], table size is
+// the last used symbol + 1. LZ77 blocks have two tables, literals with
+// lengths and distances, and their codes are followed by extra bits
+static constexpr uint8_t count_bits = 32;
+static constexpr uint8_t table_size_bits = 16;
+static constexpr uint8_t length_bits = 6;
+
+// bits taken by codes of the block
+static uint64_t code_bits(const canonical_code &code, const uint8_t *data,
+                          const size_t size)
+{
+    uint64_t encoded_bits = 0;
+    const auto &lengths = code.get_lengths();
+    for (size_t i = 0; i < size; i++)
+        encoded_bits += lengths[data[i]];
+    return encoded_bits;
+}
+
+// code lengths of used symbols, no code at all writes an empty table
+static void write_code_table(const canonical_code *code, bit_file_io &out)
+{
+    if (code == nullptr)
+    {
+        out.write_bits(0, table_size_bits);
+        return;
+    }
+
+    const auto &lengths = code->get_lengths();
+    size_t table_size = lengths.size();
+    while (lengths[table_size - 1] == 0)
+        table_size--;
+    out.write_bits(table_size, table_size_bits);
+    for (size_t i = 0; i < table_size; i++)
+        out.write_bits(lengths[i], length_bits);
+}
+
+// one bit for every byte telling whether its length changed, changed
+// lengths follow it
+static void write_table_delta(const canonical_code &previous,
+                              const canonical_code &code, bit_file_io &out)
+{
+    const auto &old_lengths = previous.get_lengths();
+    const auto &lengths = code.get_lengths();
+    for (uint16_t chr = 0; chr <= UINT8_MAX; chr++)
+    {
+        const bool changed = lengths[chr] != old_lengths[chr];
+        out.write_bits(changed, 1);
+        if (changed)
+            out.write_bits(lengths[chr], length_bits);
+    }
+}
+
+static uint64_t table_delta_bits(const canonical_code &previous,
+                                 const canonical_code &code)
+{
+    uint64_t bits = UINT8_MAX + 1;
+    for (uint16_t chr = 0; chr <= UINT8_MAX; chr++)
+        if (code.get_lengths()[chr] != previous.get_lengths()[chr])
+            bits += length_bits;
+    return bits;
+}
+
+// lengths padded to alphabet_size, empty for an empty table
+static std::vector<uint8_t> read_code_table(bit_file_io &in,
+                                            const size_t alphabet_size)
+{
+    const size_t table_size = in.read_bits(table_size_bits);
+    if (in.overrun())
+        throw std::logic_error("Compressed data is truncated.");
+    if (table_size > alphabet_size)
+        throw std::logic_error("Compressed data is corrupted.");
+    if (table_size == 0)
+        return {};
+
+    std::vector<uint8_t> lengths(alphabet_size, 0);
+    for (size_t i = 0; i < table_size; i++)
+        lengths[i] = static_cast<uint8_t>(in.read_bits(length_bits));
+    if (in.overrun())
+        throw std::logic_error("Compressed data is truncated.");
+    if (*std::max_element(lengths.begin(), lengths.end()) == 0)
+        throw std::logic_error("Compressed data is corrupted.");
+    return lengths;
+}
+
+block_codec::block_codec(const compression_options &options)
+    : options_(options)
+{
+    this->options_.max_code_length =
+        std::min(this->options_.max_code_length, canonical_code::length_limit);
+    if (this->options_.pipeline == block_pipeline::BWT)
+    {
+        this->transforms_.push_back(std::make_unique<bwt_transform>());
+        this->transforms_.push_back(std::make_unique<mtf_transform>());
+    }
+}
+
+compression_options compression_options::from_level(int level)
+{
+    compression_options options;
+    options.block_format = true;
+    level = std::min(std::max(level, min_level), max_level);
+    switch (level)
+    {
+    case 1:
+        options.stored = true;
+        break;
+    case 2:
+        options.sample_size = 65536;
+        options.max_code_length = 12;
+        options.reuse_tables = true;
+        options.reuse_threshold = 256;
+        break;
+    case 3:
+        options.max_code_length = 12;
+        options.reuse_tables = true;
+        options.reuse_threshold = 256;
+        break;
+    case 4:
+        options.reuse_tables = true;
+        break;
+    case 5:
+    case 6:
+    case 7:
+    case 8:
+    {
+        static constexpr size_t chains[] = {4, 16, 128, 1024};
+        options.pipeline = block_pipeline::LZ77;
+        options.lz77.max_chain = chains[level - 5];
+        // longer chains find longer matches, lazy matching keeps the
+        // greedy choice of one of them from hiding a better one next to it
+        options.lz77.lazy = level > 5;
+        if (level == 8)
+            options.max_code_length = canonical_code::length_limit;
+        break;
+    }
+    default:
+        options.pipeline = block_pipeline::BWT;
+        options.max_code_length = canonical_code::length_limit;
+        break;
+    }
+    return options;
+}
+
+size_t block_codec::max_payload_size(const size_t size)
+{
+    // two code tables, transform parameters and at most one symbol of at
+    // most 56 bits per byte
+    return 1024 + size * canonical_code::length_limit / CHAR_BIT;
+}
+
+uint64_t block_codec::encode(const uint8_t *data, const size_t size,
+                             std::string &payload, block_type &type) const
+{
+    type = block_type::STORED;
+    if (!this->options_.stored)
+    {
+        std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
+        uint64_t encoded_bits = 0;
+        {
+            bit_file_io out(ss, 1, size_1_mb);
+            if (this->options_.pipeline == block_pipeline::LZ77)
+                this->encode_lz77(data, size, out, encoded_bits);
+            else
+                encoded_bits = this->encode_huffman(data, size, out);
+            out.flush_bit_buffer();
+            out.flush_buffer();
+        }
+
+        payload = ss.str();
+        if (payload.size() < size)
+        {
+            type = block_type::HUFFMAN;
+            return encoded_bits;
+        }
+    }
+
+    payload.assign(reinterpret_cast<const char *>(data), size);
+    return static_cast<uint64_t>(size) * CHAR_BIT;
+}
+
+uint64_t block_codec::encode(const shared_code &shared, const uint8_t *data,
+                             const size_t size, std::string &payload,
+                             block_type &type) const
+{
+    // a block is stored when its codes alone aren't shorter than it
+    const uint64_t encoded_bits = code_bits(shared.code, data, size);
+    if (encoded_bits >= static_cast<uint64_t>(size) * CHAR_BIT)
+    {
+        type = block_type::STORED;
+        payload.assign(reinterpret_cast<const char *>(data), size);
+        return static_cast<uint64_t>(size) * CHAR_BIT;
+    }
+
+    std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
+    {
+        bit_file_io out(ss, 1, size_1_mb);
+        shared.kernels.encode(data, size, out);
+        out.flush_bit_buffer();
+        out.flush_buffer();
+    }
+    payload = ss.str();
+    type = block_type::REUSE;
+    return encoded_bits;
+}
+
+canonical_code block_codec::byte_code(const uint8_t *data, const size_t size,
+                                      freq_map &map) const
+{
+    const bool sampled =
+        this->options_.sample_size && this->options_.sample_size < size;
+    huffman_kernels::count_bytes(
+        data, sampled ? this->options_.sample_size : size, map);
+    // bytes missing in the sample still need codes
+    if (sampled)
+        for (uint16_t chr = 0; chr <= UINT8_MAX; chr++)
+            map.inc(chr);
+    return canonical_code(map, this->options_.max_code_length);
+}
+
+bool block_codec::reuses_table(const canonical_code &previous,
+                               const canonical_code &code, const freq_map &map,
+                               const size_t size) const
+{
+    const auto &lengths = previous.get_lengths();
+    uint64_t previous_bits = 0, total = 0;
+    for (uint16_t chr = 0; chr <= UINT8_MAX; chr++)
+    {
+        // previous code can't code a byte it has no code for
+        if (map.get(chr) && lengths[chr] == 0)
+            return false;
+        previous_bits += map.get(chr) * lengths[chr];
+        total += map.get(chr);
+    }
+    const uint64_t bits = code.encoded_bits(map);
+    if (total == 0 || previous_bits <= bits)
+        return true;
+
+    // sampled histogram is scaled to the whole block
+    const double extra_bits = static_cast<double>(previous_bits - bits) *
+                              static_cast<double>(size) /
+                              static_cast<double>(total);
+    return extra_bits <=
+           static_cast<double>(table_delta_bits(previous, code) +
+                               this->options_.reuse_threshold * CHAR_BIT);
+}
+
+void block_codec::encode_table(const canonical_code &code,
+                               std::string &payload,
+                               const canonical_code *previous)
+{
+    std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
+    {
+        bit_file_io out(ss, 1, size_1_mb);
+        if (previous)
+            write_table_delta(*previous, code, out);
+        else
+            write_code_table(&code, out);
+        out.flush_bit_buffer();
+        out.flush_buffer();
+    }
+    payload = ss.str();
+}
+
+std::shared_ptr<const shared_code>
+block_codec::decode_table(const std::string &payload,
+                          const shared_code *previous)
+{
+    std::stringstream ss(payload,
+                         std::ios::in | std::ios::out | std::ios::binary);
+    bit_file_io in(ss, std::max<size_t>(payload.size(), 1), 1);
+    std::vector<uint8_t> lengths;
+    if (previous == nullptr)
+        lengths = read_code_table(in, UINT8_MAX + 1);
+    else
+    {
+        lengths = previous->code.get_lengths();
+        for (uint16_t chr = 0; chr <= UINT8_MAX; chr++)
+            if (in.read_bits(1))
+                lengths[chr] = static_cast<uint8_t>(in.read_bits(length_bits));
+        if (in.overrun())
+            throw std::logic_error("Compressed data is truncated.");
+    }
+    if (lengths.empty() ||
+        *std::max_element(lengths.begin(), lengths.end()) == 0)
+        throw std::logic_error("Compressed data is corrupted.");
+    return std::make_shared<const shared_code>(
+        canonical_code(std::move(lengths)));
+}
+
+void block_codec::decode(const block_type type, const std::string &payload,
+                         uint8_t *out, const size_t size,
+                         const shared_code *shared) const
+{
+    if (type == block_type::STORED)
+    {
+        if (payload.size() != size)
+            throw std::logic_error("Compressed data is corrupted.");
+        std::copy(payload.begin(), payload.end(), out);
+        return;
+    }
+
+    std::stringstream ss(payload,
+                         std::ios::in | std::ios::out | std::ios::binary);
+    bit_file_io in(ss, std::max<size_t>(payload.size(), 1), 1);
+    if (type == block_type::REUSE)
+    {
+        // shared codes exist only for bytes coded directly
+        if (shared == nullptr ||
+            this->options_.pipeline != block_pipeline::HUFFMAN)
+            throw std::logic_error("Compressed data is corrupted.");
+        shared->kernels.decode(in, out, size);
+        return;
+    }
+    if (this->options_.pipeline == block_pipeline::LZ77)
+        this->decode_lz77(in, out, size);
+    else
+        this->decode_huffman(in, out, size);
+}
+
+uint64_t block_codec::encode_huffman(const uint8_t *data, const size_t size,
+                                     bit_file_io &out) const
+{
+    std::vector<uint8_t> block;
+    std::vector<uint32_t> parameters;
+    if (!this->transforms_.empty())
+    {
+        block.assign(data, data + size);
+        for (const auto &transform : this->transforms_)
+            parameters.push_back(transform->forward(block));
+        data = block.data();
+    }
+
+    std::vector<uint16_t> symbols;
+    const bool wide = this->options_.pipeline != block_pipeline::HUFFMAN;
+    freq_map map(wide ? run_length_alphabet_size : UINT8_MAX + 1);
+    if (wide)
+    {
+        if (this->options_.pipeline == block_pipeline::BWT)
+            zero_run_encode(data, size, symbols);
+        else
+            run_length_encode(data, size, symbols);
+        for (const uint16_t symbol : symbols)
+            map.inc(symbol);
+    }
+
+    const canonical_code code =
+        wide ? canonical_code(map, this->options_.max_code_length)
+             : this->byte_code(data, size, map);
+    huffman_kernels kernels(code);
+    if (size >= huffman_kernels::pair_codes_min_size)
+        kernels.enable_pair_codes();
+
+    out.write_bits(wide ? symbols.size() : size, count_bits);
+    for (size_t i = 0; i < parameters.size(); i++)
+        out.write_bits(parameters[i], this->transforms_[i]->parameter_bits());
+    write_code_table(&code, out);
+
+    if (kernels.is_wide())
+    {
+        kernels.encode_symbols(symbols.data(), symbols.size(), out);
+        return code.encoded_bits(map);
+    }
+    kernels.encode(data, size, out);
+
+    // sampled histogram doesn't tell how many bits the block took
+    return code_bits(code, data, size);
+}
+
+void block_codec::decode_huffman(bit_file_io &in, uint8_t *out,
+                                 const size_t size) const
+{
+    const bool wide = this->options_.pipeline != block_pipeline::HUFFMAN;
+    const size_t alphabet_size =
+        wide ? run_length_alphabet_size : UINT8_MAX + 1;
+    const size_t count = in.read_bits(count_bits);
+    std::vector<uint32_t> parameters;
+    for (const auto &transform : this->transforms_)
+    {
+        const uint8_t bits = transform->parameter_bits();
+        parameters.push_back(bits ? static_cast<uint32_t>(in.read_bits(bits))
+                                  : 0);
+    }
+    if (count > size || (!wide && count != size))
+        throw std::logic_error("Compressed data is corrupted.");
+
+    auto lengths = read_code_table(in, alphabet_size);
+    if (lengths.empty())
+        throw std::logic_error("Compressed data is corrupted.");
+    const canonical_code code(std::move(lengths));
+    const huffman_kernels kernels(code);
+
+    if (!kernels.is_wide())
+        kernels.decode(in, out, size);
+    else
+    {
+        std::vector<uint16_t> symbols(count);
+        kernels.decode_symbols(in, symbols.data(), count);
+        if (this->options_.pipeline == block_pipeline::BWT)
+            zero_run_decode(symbols.data(), count, out, size);
+        else
+            run_length_decode(symbols.data(), count, out, size);
+    }
+    if (this->transforms_.empty())
+        return;
+
+    std::vector<uint8_t> block(out, out + size);
+    for (size_t i = this->transforms_.size(); i-- > 0;)
+        this->transforms_[i]->inverse(block, parameters[i]);
+    std::copy(block.begin(), block.end(), out);
+}
+
+// literals with lengths, then distances, then extra bits of every match,
+// each stream is coded by its own kernels
+void block_codec::encode_lz77(const uint8_t *data, const size_t size,
+                              bit_file_io &out, uint64_t &encoded_bits) const
+{
+    lz77_block block;
+    lz77_encode(data, size, this->options_.lz77, block);
+
+    freq_map literal_map(lz77_literal_alphabet_size);
+    for (const uint16_t symbol : block.literals)
+        literal_map.inc(symbol);
+    freq_map distance_map(lz77_distance_alphabet_size);
+    for (const uint8_t symbol : block.distances)
+        distance_map.inc(symbol);
+
+    const canonical_code literal_code(literal_map,
+                                      this->options_.max_code_length);
+    std::unique_ptr<canonical_code> distance_code;
+    if (!block.distances.empty())
+        distance_code = std::make_unique<canonical_code>(
+            distance_map, this->options_.max_code_length);
+
+    out.write_bits(block.literals.size(), count_bits);
+    write_code_table(&literal_code, out);
+    write_code_table(distance_code.get(), out);
+
+    huffman_kernels(literal_code)
+        .encode_symbols(block.literals.data(), block.literals.size(), out);
+    encoded_bits = literal_code.encoded_bits(literal_map);
+    if (distance_code)
+    {
+        huffman_kernels(*distance_code)
+            .encode(block.distances.data(), block.distances.size(), out);
+        encoded_bits += distance_code->encoded_bits(distance_map);
+    }
+    for (const uint32_t extra : block.extra_bits)
+    {
+        out.write_bits(extra >> 8, static_cast<uint8_t>(extra & UINT8_MAX));
+        encoded_bits += extra & UINT8_MAX;
+    }
+}
+
+void block_codec::decode_lz77(bit_file_io &in, uint8_t *out,
+                              const size_t size) const
+{
+    const size_t count = in.read_bits(count_bits);
+    if (in.overrun() || count > size)
+        throw std::logic_error("Compressed data is corrupted.");
+    auto literal_lengths = read_code_table(in, lz77_literal_alphabet_size);
+    auto distance_lengths = read_code_table(in, lz77_distance_alphabet_size);
+    if (literal_lengths.empty())
+        throw std::logic_error("Compressed data is corrupted.");
+
+    const canonical_code literal_code(std::move(literal_lengths));
+    std::vector<uint16_t> literals(count);
+    huffman_kernels(literal_code).decode_symbols(in, literals.data(), count);
+
+    const size_t matches = lz77_match_count(literals.data(), count);
+    std::vector<uint8_t> distances(matches);
+    if (matches > 0)
+    {
+        if (distance_lengths.empty())
+            throw std::logic_error("Compressed data is corrupted.");
+        const canonical_code distance_code(std::move(distance_lengths));
+        huffman_kernels(distance_code).decode(in, distances.data(), matches);
+    }
+    lz77_decode(literals.data(), count, distances.data(), in, out, size);
+}
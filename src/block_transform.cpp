@@ -0,0 +1,159 @@
+﻿#include "../inc/block_transform.h"
+
+#include "../inc/consts.h"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+// sorts cyclic shifts of the block with a sentinel smaller than any byte
+// appended, which is the same as sorting its suffixes. Prefix doubling with
+// counting sort, O(n log n)
+static std::vector<uint32_t> suffix_array(const std::vector<uint8_t> &block)
+{
+    const size_t n = block.size() + 1;
+    std::vector<uint32_t> sa(n), rank(n), next_sa(n), next_rank(n);
+    std::vector<uint32_t> count(std::max<size_t>(n, UINT8_MAX + 2), 0);
+
+    // sentinel is 0, bytes are shifted by one
+    auto symbol = [&block, n](const size_t i)
+    { return i + 1 == n ? 0u : block[i] + 1u; };
+    for (size_t i = 0; i < n; i++)
+        count[symbol(i)]++;
+    std::partial_sum(count.begin(), count.begin() + UINT8_MAX + 2,
+                     count.begin());
+    for (size_t i = n; i-- > 0;)
+        sa[--count[symbol(i)]] = static_cast<uint32_t>(i);
+
+    uint32_t classes = 1;
+    rank[sa[0]] = 0;
+    for (size_t i = 1; i < n; i++)
+    {
+        if (symbol(sa[i]) != symbol(sa[i - 1]))
+            classes++;
+        rank[sa[i]] = classes - 1;
+    }
+
+    for (size_t half = 1; classes < n; half <<= 1)
+    {
+        // shifts sorted by second half, then stable sort by first half.
+        // classes < n means half < n, so a single wrap is enough
+        for (size_t i = 0; i < n; i++)
+            next_sa[i] = static_cast<uint32_t>(sa[i] >= half ? sa[i] - half
+                                                             : sa[i] + n - half);
+        std::fill(count.begin(), count.begin() + classes, 0);
+        for (size_t i = 0; i < n; i++)
+            count[rank[next_sa[i]]]++;
+        std::partial_sum(count.begin(), count.begin() + classes,
+                         count.begin());
+        for (size_t i = n; i-- > 0;)
+            sa[--count[rank[next_sa[i]]]] = next_sa[i];
+
+        auto second = [&rank, n, half](const size_t i)
+        { return rank[i + half < n ? i + half : i + half - n]; };
+        classes = 1;
+        next_rank[sa[0]] = 0;
+        for (size_t i = 1; i < n; i++)
+        {
+            if (rank[sa[i]] != rank[sa[i - 1]] ||
+                second(sa[i]) != second(sa[i - 1]))
+                classes++;
+            next_rank[sa[i]] = classes - 1;
+        }
+        rank.swap(next_rank);
+    }
+    return sa;
+}
+
+uint32_t bwt_transform::forward(std::vector<uint8_t> &block) const
+{
+    const size_t n = block.size() + 1;
+    const auto sa = suffix_array(block);
+
+    // last column without the sentinel, the parameter tells where it was
+    std::vector<uint8_t> last;
+    last.reserve(block.size());
+    uint32_t primary = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (sa[i] == 0)
+            primary = static_cast<uint32_t>(i);
+        else
+            last.push_back(block[sa[i] - 1]);
+    }
+    block.swap(last);
+    return primary;
+}
+
+void bwt_transform::inverse(std::vector<uint8_t> &block,
+                            const uint32_t parameter) const
+{
+    const size_t n = block.size() + 1;
+    if (parameter == 0 || parameter >= n)
+        throw std::logic_error("Compressed data is corrupted.");
+
+    // last column with the sentinel at parameter, first column is the same
+    // bytes sorted, so the sentinel row is followed by rows starting with
+    // the smallest byte
+    auto at = [&block, parameter](const size_t i)
+    { return i < parameter ? block[i] : block[i - 1]; };
+
+    uint32_t first[UINT8_MAX + 1] = {};
+    for (const uint8_t byte : block)
+        first[byte]++;
+    uint32_t sum = 1;
+    for (uint32_t &count : first)
+    {
+        const uint32_t c = count;
+        count = sum;
+        sum += c;
+    }
+
+    // lf[i] -> row starting with the byte ending row i
+    std::vector<uint32_t> lf(n, 0);
+    for (size_t i = 0; i < n; i++)
+        if (i != parameter)
+            lf[i] = first[at(i)]++;
+
+    // row 0 starts with the sentinel, so it ends with the last byte
+    std::vector<uint8_t> original(block.size());
+    size_t row = 0;
+    for (size_t k = original.size(); k-- > 0;)
+    {
+        if (row == parameter)
+            throw std::logic_error("Compressed data is corrupted.");
+        original[k] = at(row);
+        row = lf[row];
+    }
+    block.swap(original);
+}
+
+uint32_t mtf_transform::forward(std::vector<uint8_t> &block) const
+{
+    uint8_t order[UINT8_MAX + 1];
+    std::iota(order, order + UINT8_MAX + 1, 0);
+    for (uint8_t &byte : block)
+    {
+        uint8_t index = 0;
+        while (order[index] != byte)
+            index++;
+        std::move_backward(order, order + index, order + index + 1);
+        order[0] = byte;
+        byte = index;
+    }
+    return 0;
+}
+
+void mtf_transform::inverse(std::vector<uint8_t> &block,
+                            const uint32_t parameter) const
+{
+    UNUSED(parameter);
+    uint8_t order[UINT8_MAX + 1];
+    std::iota(order, order + UINT8_MAX + 1, 0);
+    for (uint8_t &index : block)
+    {
+        const uint8_t byte = order[index];
+        std::move_backward(order, order + index, order + index + 1);
+        order[0] = byte;
+        index = byte;
+    }
+}
@@ -0,0 +1,103 @@
+﻿#include "../inc/canonical_code.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+canonical_code::canonical_code(const freq_map &map, uint8_t max_length)
+    : lengths_(map.alphabet_size(), 0)
+{
+    max_length = std::min(std::max<uint8_t>(max_length, 1), length_limit);
+
+    // optimal lengths, may be longer than max_length
+    const huffman_tree tree(map);
+    const auto codes = tree.get_codes();
+    std::vector<uint32_t> length_count(max_length + 1, 0);
+    std::vector<uint16_t> used;
+    for (size_t i = 0; i < this->lengths_.size(); i++)
+    {
+        if (map.get(static_cast<uint16_t>(i)) == 0)
+            continue;
+        used.push_back(static_cast<uint16_t>(i));
+        length_count[std::min<size_t>(codes[i].size(), max_length)]++;
+    }
+
+    // too long codes were shortened to max_length, which breaks kraft
+    // inequality. Every step removes one code of max_length and splits
+    // the longest shorter code into two, so kraft sum drops by one unit
+    uint64_t kraft = 0;
+    for (uint8_t len = 1; len <= max_length; len++)
+        kraft += static_cast<uint64_t>(length_count[len]) << (max_length - len);
+    while (kraft > (static_cast<uint64_t>(1) << max_length))
+    {
+        length_count[max_length]--;
+        for (uint8_t len = max_length - 1; len > 0; len--)
+        {
+            if (length_count[len])
+            {
+                length_count[len]--;
+                length_count[len + 1] += 2;
+                break;
+            }
+        }
+        kraft--;
+    }
+
+    // most frequent symbols get shortest codes
+    std::stable_sort(used.begin(), used.end(),
+                     [&map](const uint16_t a, const uint16_t b)
+                     { return map.get(a) > map.get(b); });
+    size_t next = 0;
+    for (uint8_t len = 1; len <= max_length; len++)
+        for (uint32_t i = 0; i < length_count[len]; i++)
+            this->lengths_[used[next++]] = len;
+
+    this->assign_codes();
+}
+
+canonical_code::canonical_code(std::vector<uint8_t> lengths)
+    : lengths_(std::move(lengths))
+{
+    this->assign_codes();
+}
+
+void canonical_code::assign_codes()
+{
+    std::vector<uint64_t> length_count(length_limit + 1, 0);
+    for (const uint8_t len : this->lengths_)
+    {
+        if (len > length_limit)
+            throw std::logic_error("Invalid code length.");
+        length_count[len]++;
+        this->max_length_ = std::max(this->max_length_, len);
+    }
+
+    // kraft inequality, otherwise some codes would be prefixes of others
+    uint64_t kraft = 0;
+    for (uint8_t len = 1; len <= this->max_length_; len++)
+        kraft += length_count[len] << (this->max_length_ - len);
+    if (kraft > (static_cast<uint64_t>(1) << this->max_length_))
+        throw std::logic_error("Invalid code lengths.");
+
+    std::vector<uint64_t> next_code(length_limit + 2, 0);
+    uint64_t code = 0;
+    length_count[0] = 0;
+    for (uint8_t len = 1; len <= this->max_length_; len++)
+    {
+        code = (code + length_count[len - 1]) << 1;
+        next_code[len] = code;
+    }
+
+    this->codes_.assign(this->lengths_.size(), 0);
+    for (size_t i = 0; i < this->lengths_.size(); i++)
+        if (this->lengths_[i])
+            this->codes_[i] = next_code[this->lengths_[i]]++;
+}
+
+uint64_t canonical_code::encoded_bits(const freq_map &map) const
+{
+    uint64_t bits = 0;
+    for (size_t i = 0; i < this->lengths_.size(); i++)
+        bits += map.get(static_cast<uint16_t>(i)) * this->lengths_[i];
+    return bits;
+}
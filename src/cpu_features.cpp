@@ -0,0 +1,34 @@
+﻿#include "../inc/cpu_features.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+cpu_features::cpu_features()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    this->bmi2_ = __builtin_cpu_supports("bmi2");
+    this->avx2_ = __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7)
+        return;
+
+    __cpuid(regs, 1);
+    const bool os_avx = (regs[2] & (1 << 27)) && (regs[2] & (1 << 28)) &&
+                        (_xgetbv(0) & 6) == 6;
+
+    __cpuidex(regs, 7, 0);
+    this->bmi2_ = (regs[1] & (1 << 8)) != 0;
+    this->avx2_ = os_avx && (regs[1] & (1 << 5)) != 0;
+#endif
+}
+
+const cpu_features &cpu_features::get()
+{
+    static const cpu_features features;
+    return features;
+}
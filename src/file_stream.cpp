@@ -0,0 +1,49 @@
+﻿#include "../inc/file_stream.h"
+
+#include "../inc/consts.h"
+
+file_stream::file_stream(const std::string &path, const bool write,
+                         const io_mode mode)
+    : std::iostream(nullptr), path_(path)
+{
+    bool opened = false;
+    if (mode == io_mode::STREAM)
+    {
+        auto buffer = std::make_unique<std::filebuf>();
+        opened = buffer->open(path, (write ? std::ios::out : std::ios::in) |
+                                        std::ios_base::binary) != nullptr;
+        this->buffer_ = std::move(buffer);
+    }
+    else
+    {
+        this->raw_ = std::make_unique<raw_file>(path, write,
+                                                mode == io_mode::DIRECT);
+        opened = this->raw_->is_open();
+        this->buffer_ =
+            std::make_unique<raw_file_buf>(*this->raw_, write, size_1_mb);
+    }
+
+    this->rdbuf(this->buffer_.get());
+    if (!opened)
+        this->setstate(std::ios_base::failbit);
+}
+
+bool file_stream::preallocate(const uint64_t size)
+{
+    // std::filebuf has no descriptor, the file is opened once more
+    if (this->raw_ == nullptr)
+        return raw_file::allocate(this->path_, size);
+    return this->raw_->allocate(size);
+}
+
+void file_stream::close()
+{
+    bool closed = true;
+    if (this->raw_ == nullptr)
+        closed = static_cast<std::filebuf *>(this->buffer_.get())->close() !=
+                 nullptr;
+    else if (this->raw_->is_open())
+        closed = this->buffer_->pubsync() == 0 && this->raw_->close();
+    if (!closed)
+        this->setstate(std::ios_base::failbit);
+}
@@ -1,17 +1,49 @@
 ﻿#include "../inc/huffman_encoder.h"
 
 #include "../inc/bit_file_io.h"
+#include "../inc/block_codec.h"
+#include "../inc/huffman_format.h"
+#include "../inc/huffman_kernels.h"
 #include "../inc/huffman_tree.h"
 #include "../inc/ui.h"
 #include <algorithm>
+#include <chrono>
 #include <climits>
+#include <cstdio>
+#include <exception>
 #include <fstream>
+#include <future>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <thread>
 #include <unordered_map>
 
-static void write_file_header(const freq_map &map, uint8_t padding,
-                              std::fstream &output_file, bit_file_io &wrapper);
-static huffman_tree *read_file_header(std::fstream &file, bit_file_io &wrapper);
+using stats_clock = std::chrono::steady_clock;
+
+static double seconds_since(const stats_clock::time_point start)
+{
+    return std::chrono::duration<double>(stats_clock::now() - start).count();
+}
+
+// seconds elapsed since start, start is moved to now
+static double lap(stats_clock::time_point &start)
+{
+    const double seconds = seconds_since(start);
+    start = stats_clock::now();
+    return seconds;
+}
+
+// sizes read from a header are untrusted, space is reserved up front for at
+// most this many times the compressed size. One bit per byte is the
+// shortest huffman code
+static constexpr uint64_t max_preallocated_ratio = 8;
+
+static uint64_t preallocated_size(const uint64_t original_size,
+                                  const uint64_t compressed_size)
+{
+    return std::min(original_size, compressed_size * max_preallocated_ratio);
+}
 
 huffman_encoder::huffman_encoder(std::string input_file,
                                  std::string output_file, const ui &ui,
@@ -23,12 +55,63 @@ huffman_encoder::huffman_encoder(std::string input_file,
 
 huffman_encoder::~huffman_encoder() { delete[] buffer_; }
 
+/**
+ * @brief Counts bytes of the whole input into map. Returns false when ui asked
+ * to stop
+ */
+bool huffman_encoder::count_frequency(file_stream &input_file, freq_map &map,
+                                      uint64_t &progress,
+                                      const uint64_t progress_total)
+{
+    // https://stackoverflow.com/a/67854635
+    while (input_file.good())
+    {
+        input_file.read(
+            reinterpret_cast<char *>(this->buffer_),
+            static_cast<std::streamsize>(sizeof(uint8_t) * this->buffer_size_));
+        this->buffer_cnt_ = static_cast<size_t>(input_file.gcount());
+        huffman_kernels::count_bytes(this->buffer_, this->buffer_cnt_, map);
+
+        progress += this->buffer_cnt_;
+        if (!this->ui_.report_progress(progress, progress_total))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Closes and removes the partial output file
+ */
+void huffman_encoder::remove_output(file_stream &output_file) const
+{
+    output_file.close();
+    std::remove(this->output_file_.c_str());
+}
+
+/**
+ * @brief Reports progress to ui. When ui asks to stop, the partial output
+ * file is closed and removed
+ */
+bool huffman_encoder::cancelled(const uint64_t processed, const uint64_t total,
+                                file_stream &output_file) const
+{
+    if (this->ui_.report_progress(processed, total))
+        return false;
+
+    this->remove_output(output_file);
+    return true;
+}
+
 void huffman_encoder::compress_file()
 {
+    const auto started = stats_clock::now();
+    auto phase = started;
+    this->stats_ = huffman_stats();
+    this->stats_.operation = "compress";
+
     this->ui_.write_message("Starting compression...");
     this->ui_.write_message("Output file: " + this->output_file_);
-    std::fstream input_file(this->input_file_,
-                            std::ios::in | std::ios_base::binary);
+    file_stream input_file(this->input_file_, false, this->io_mode_);
 
 	//checking input and output files
     if (!input_file.good() ||
@@ -39,8 +122,7 @@ void huffman_encoder::compress_file()
         return;
     }
 
-    std::fstream output_file(this->output_file_,
-                             std::ios::out | std::ios_base::binary);
+    file_stream output_file(this->output_file_, true, this->io_mode_);
     if (!output_file.good())
     {
         input_file.close();
@@ -49,52 +131,65 @@ void huffman_encoder::compress_file()
         return;
     }
 
+    if (this->options_.uses_blocks())
+    {
+        if (!this->compress_blocks(input_file, output_file))
+        {
+            this->ui_.app_error("Compression cancelled.");
+            return;
+        }
+        input_file.close();
+        output_file.close();
+        this->stats_.total_seconds = seconds_since(started);
+        this->ui_.write_message("Compression finished");
+        return;
+    }
+
     bit_file_io output_file_bit_io(output_file, 1, size_16_mb);
 
+    // both passes read whole input
+    input_file.seekg(0, std::ios_base::end);
+    const uint64_t progress_total = 2 * static_cast<uint64_t>(input_file.tellg());
+    input_file.seekg(0, std::ios_base::beg);
+    uint64_t progress = 0;
+
     this->ui_.write_message("Counting byte frequency...");
+    phase = stats_clock::now();
 
 	//read and count bytes from file
     freq_map map;
-    // https://stackoverflow.com/a/67854635
-
-    while (input_file.good())
+    if (!this->count_frequency(input_file, map, progress, progress_total))
     {
-        input_file.read(
-            reinterpret_cast<char *>(this->buffer_),
-            static_cast<std::streamsize>(sizeof(uint8_t) * this->buffer_size_));
-        this->buffer_cnt_ = static_cast<size_t>(input_file.gcount());
-        for (size_t i = 0; i < buffer_cnt_; i++)
-        {
-            uint8_t byte = this->buffer_[i];
-            map.inc(byte);
-        }
+        this->remove_output(output_file);
+        this->ui_.app_error("Compression cancelled.");
+        return;
+    }
+    // a read error mustn't look like the end of the input
+    if (input_file.bad())
+    {
+        this->remove_output(output_file);
+        this->ui_.app_error("Cannot read input file.");
+        return;
     }
 
+    this->stats_.histogram_seconds = lap(phase);
+    this->stats_.histogram_measured = true;
     this->ui_.write_message("Finished counting bytes.");
 
     this->ui_.write_message("Building huffman tree...");
 	//create a huffman tree and create codes for each byte
     const huffman_tree *tree = new huffman_tree(map);
-    auto codes = tree->get_codes();
+    const huffman_kernels kernels(*tree);
+    this->stats_.tree_build_seconds = lap(phase);
+    this->stats_.set_code_stats(map, *tree);
     this->ui_.write_message("Tree created, and codes generated.");
 
-	//code may not be length mult of 8
-	//in this case we should add padding before code
-    // calculate needed padding
-    uint8_t padding = 0;
-    for (uint16_t i = 0; i <= UINT8_MAX; i++)
-    {
-		padding = (padding + ((codes[i].size() % CHAR_BIT) *
-			(map.get(static_cast<uint8_t>(i)) % CHAR_BIT)) %
-			CHAR_BIT) %
-			CHAR_BIT;
-    }
-
-
-	padding = padding > 0 ? CHAR_BIT - padding : 0;
+    const uint8_t padding = code_padding(map, *tree);
     this->ui_.write_message("Writing file header...");
 	//create and write header to file
+    phase = stats_clock::now();
     write_file_header(map, padding, output_file, output_file_bit_io);
+    this->stats_.header_seconds = lap(phase);
     this->ui_.write_message("File header written.");
 
     input_file.clear(); // clear eof flag
@@ -108,34 +203,56 @@ void huffman_encoder::compress_file()
             reinterpret_cast<char *>(this->buffer_),
             static_cast<std::streamsize>(sizeof(uint8_t) * this->buffer_size_));
         this->buffer_cnt_ = static_cast<size_t>(input_file.gcount());
-        for (size_t i = 0; i < this->buffer_cnt_; i++)
+        kernels.encode(this->buffer_, this->buffer_cnt_, output_file_bit_io);
+        this->stats_.original_size += this->buffer_cnt_;
+
+        progress += this->buffer_cnt_;
+        if (this->cancelled(progress, progress_total, output_file))
         {
-            uint8_t byte = this->buffer_[i];
-            auto &code = codes[byte];
-            for (bool bit : code)
-                output_file_bit_io << (bit ? 1 : 0);
+            delete tree;
+            this->ui_.app_error("Compression cancelled.");
+            return;
         }
     }
+    if (input_file.bad() || this->stats_.original_size != map.total())
+    {
+        delete tree;
+        this->remove_output(output_file);
+        this->ui_.app_error(input_file.bad()
+                                ? "Cannot read input file."
+                                : "Input file changed while it was read.");
+        return;
+    }
+    this->stats_.transform_seconds = lap(phase);
 
 	//flush buffers
     output_file_bit_io.flush_bit_buffer();
     output_file_bit_io.flush_buffer();
-
-    this->ui_.write_message("Compression finished");
+    this->stats_.compressed_size = static_cast<uint64_t>(output_file.tellp());
 
     input_file.close();
     output_file.close();
+    this->stats_.flush_seconds = lap(phase);
+
+    this->stats_.bytes_in = this->stats_.original_size;
+    this->stats_.bytes_out = this->stats_.compressed_size;
+    this->stats_.total_seconds = seconds_since(started);
+    this->ui_.write_message("Compression finished");
 
     delete tree;
 }
 
 void huffman_encoder::decompress_file()
 {
+    const auto started = stats_clock::now();
+    auto phase = started;
+    this->stats_ = huffman_stats();
+    this->stats_.operation = "decompress";
+
     this->ui_.write_message("Starting decompression...");
 
 	//check input output files
-    std::fstream input_file(this->input_file_,
-                            std::ios::in | std::ios_base::binary);
+    file_stream input_file(this->input_file_, false, this->io_mode_);
     if (!input_file.good() ||
         input_file.peek() == std::ifstream::traits_type::eof())
     {
@@ -143,10 +260,12 @@ void huffman_encoder::decompress_file()
         this->ui_.app_error("Input file doesn't exists, or it's empty.");
         return;
     }
+    input_file.seekg(0, std::ios_base::end);
+    this->stats_.compressed_size = static_cast<uint64_t>(input_file.tellg());
+    input_file.seekg(0, std::ios_base::beg);
     bit_file_io input_file_bit_io(input_file, size_16_mb, 1);
 
-    std::fstream output_file(this->output_file_,
-                             std::ios::out | std::ios_base::binary);
+    file_stream output_file(this->output_file_, true, this->io_mode_);
     if (!output_file.good())
     {
         input_file.close();
@@ -158,112 +277,579 @@ void huffman_encoder::decompress_file()
     this->ui_.write_message("Reading file header and rebuilding tree...");
 	//read file header and construct tree from it
     const huffman_tree *tree;
+    freq_map map;
+    phase = stats_clock::now();
     try
     {
-        tree = read_file_header(input_file, input_file_bit_io);
+        block_pipeline pipeline = block_pipeline::HUFFMAN;
+        uint64_t original_size = unknown_size;
+        if (read_container_header(input_file, pipeline, original_size))
+        {
+            if (original_size != unknown_size)
+                output_file.preallocate(preallocated_size(
+                    original_size, this->stats_.compressed_size));
+            if (!this->decompress_blocks(input_file, output_file, pipeline,
+                                         original_size))
+            {
+                this->ui_.app_error("Decompression cancelled.");
+                return;
+            }
+            input_file.close();
+            output_file.close();
+            this->stats_.total_seconds = seconds_since(started);
+            this->ui_.write_message("Decompression finished");
+            return;
+        }
+        tree = read_file_header(input_file, input_file_bit_io, map);
     }
     catch (const std::logic_error &ex)
     {
+        this->remove_output(output_file);
         ui_.app_error(ex.what());
         return;
     }
+    this->stats_.header_seconds = lap(phase);
+    output_file.preallocate(
+        preallocated_size(map.total(), this->stats_.compressed_size));
+    const huffman_kernels kernels(*tree);
+    this->stats_.tree_build_seconds = lap(phase);
+    this->stats_.set_code_stats(map, *tree);
     this->ui_.write_message("Tree created.");
 
     this->ui_.write_message("Transforming bytes...");
-	//read code bit by bit, and assemble bytes
+	//decode buffer by buffer, the header tells how many bytes there are
 	//then write decompressed bytes to the output file
-    uint8_t bit = 0, byte = 0;
-    while (input_file_bit_io >> bit)
+    const uint64_t progress_total = map.total();
+    uint64_t bytes_left = progress_total;
+    try
     {
-        if (tree->try_get_byte(byte, bit))
+        while (bytes_left > 0)
         {
-            this->buffer_[this->buffer_cnt_++] = byte;
-            if (this->buffer_cnt_ == this->buffer_size_)
+            this->buffer_cnt_ = static_cast<size_t>(
+                std::min<uint64_t>(bytes_left, this->buffer_size_));
+            kernels.decode(input_file_bit_io, this->buffer_, this->buffer_cnt_);
+            output_file.write(reinterpret_cast<char *>(this->buffer_),
+                              static_cast<std::streamsize>(
+                                  sizeof(uint8_t) * this->buffer_cnt_));
+            bytes_left -= this->buffer_cnt_;
+            this->stats_.original_size += this->buffer_cnt_;
+
+            if (this->cancelled(this->stats_.original_size, progress_total,
+                                output_file))
             {
-                output_file.write(reinterpret_cast<char *>(this->buffer_),
-                                  static_cast<std::streamsize>(
-                                      sizeof(uint8_t) * this->buffer_size_));
-                this->buffer_cnt_ = 0;
+                delete tree;
+                this->ui_.app_error("Decompression cancelled.");
+                return;
             }
         }
+        this->buffer_cnt_ = 0;
     }
-
-	//flush buffer
-    if (buffer_cnt_ > 0)
+    catch (const std::logic_error &ex)
     {
-        output_file.write(
-            reinterpret_cast<char *>(this->buffer_),
-            static_cast<std::streamsize>(sizeof(uint8_t) * this->buffer_cnt_));
-        this->buffer_cnt_ = 0;
+        delete tree;
+        this->remove_output(output_file);
+        ui_.app_error(ex.what());
+        return;
     }
+    this->stats_.transform_seconds = lap(phase);
 
-    this->ui_.write_message("Decompression finished");
     input_file.close();
     output_file.close();
+    this->stats_.flush_seconds = lap(phase);
+
+    this->stats_.bytes_in = this->stats_.compressed_size;
+    this->stats_.bytes_out = this->stats_.original_size;
+    this->stats_.total_seconds = seconds_since(started);
+    this->ui_.write_message("Decompression finished");
 
     delete tree;
 }
 
-static void write_file_header(const freq_map &map, const uint8_t padding,
-                              std::fstream &output_file, bit_file_io &wrapper)
+// blocks coded at once, limited by threads and by the buffer size
+static size_t blocks_per_batch(const compression_options &options,
+                               const size_t buffer_size,
+                               const size_t block_size)
 {
-    uint8_t buf[2] = {
-        static_cast<uint8_t>(map.size() -
-                             1), // bytes_size + 1 = unique bytes count;
-        padding                  // needed padding for huffman code
-    };
-
-    output_file.write(reinterpret_cast<char *>(&buf), sizeof(buf));
+    size_t threads = options.threads;
+    if (threads == 0)
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    return std::max<size_t>(1, std::min(threads, buffer_size / block_size));
+}
 
-	//write bytes frequency
+/**
+ * @brief Counts bytes of options_.table_sample bytes of the input into map,
+ * taken from its beginning or from chunks spread evenly over it. Every byte
+ * gets one more occurrence. The input is rewound afterwards
+ */
+void huffman_encoder::sample_frequency(file_stream &input_file,
+                                       const uint64_t input_size,
+                                       freq_map &map)
+{
+    static constexpr uint64_t chunk_size = 65536;
+    const uint64_t sample_size =
+        std::min<uint64_t>(this->options_.table_sample, input_size);
+    const uint64_t chunk = std::min<uint64_t>(
+        this->options_.strided_sample ? chunk_size : sample_size,
+        this->buffer_size_);
+    const uint64_t chunks = std::max<uint64_t>(sample_size / chunk, 1);
+
+    for (uint64_t i = 0; i < chunks; i++)
+    {
+        // prefix sample reads consecutive chunks
+        if (this->options_.strided_sample && chunks > 1)
+            input_file.seekg(static_cast<std::streamoff>(
+                i * (input_size - chunk) / (chunks - 1)));
+        input_file.read(reinterpret_cast<char *>(this->buffer_),
+                        static_cast<std::streamsize>(chunk));
+        huffman_kernels::count_bytes(
+            this->buffer_, static_cast<size_t>(input_file.gcount()), map);
+    }
     for (uint16_t chr = 0; chr <= UINT8_MAX; chr++)
+        map.inc(chr);
+
+    input_file.clear();
+    input_file.seekg(0, std::ios_base::beg);
+}
+
+// code table block, it decodes to no bytes
+static void write_table_block(std::ostream &output_file, const block_type type,
+                              const std::string &table)
+{
+    write_block_header(output_file, type, 0,
+                       static_cast<uint32_t>(table.size()));
+    output_file.write(table.data(), static_cast<std::streamsize>(table.size()));
+}
+
+/**
+ * @brief Writes the block container, every batch of blocks is read, coded in
+ * parallel and written in order in one pass. Returns false when ui asked to
+ * stop
+ */
+bool huffman_encoder::compress_blocks(file_stream &input_file,
+                                      file_stream &output_file)
+{
+    auto phase = stats_clock::now();
+    input_file.seekg(0, std::ios_base::end);
+    const uint64_t progress_total = static_cast<uint64_t>(input_file.tellg());
+    input_file.seekg(0, std::ios_base::beg);
+
+    const block_codec codec(this->options_);
+    const size_t block_size = std::min<size_t>(
+        std::min(this->options_.block_size, this->buffer_size_), UINT32_MAX);
+    const size_t batch =
+        blocks_per_batch(this->options_, this->buffer_size_, block_size);
+    write_container_header(output_file, this->options_.pipeline,
+                           progress_total);
+    this->stats_.header_seconds = lap(phase);
+
+    // one code table from a sample of the input, blocks are coded with it
+    // as they are read
+    const bool byte_codes = !this->options_.stored &&
+                            this->options_.pipeline == block_pipeline::HUFFMAN;
+    std::shared_ptr<const shared_code> shared;
+    if (this->options_.table_sample && byte_codes)
+    {
+        this->ui_.write_message("Sampling byte frequency...");
+        freq_map map(UINT8_MAX + 1);
+        this->sample_frequency(input_file, progress_total, map);
+        shared = std::make_shared<const shared_code>(
+            canonical_code(map, std::min(this->options_.max_code_length,
+                                         canonical_code::length_limit)),
+            progress_total >= huffman_kernels::pair_codes_min_size);
+
+        std::string table;
+        block_codec::encode_table(shared->code, table);
+        write_table_block(output_file, block_type::CODE_TABLE, table);
+        this->stats_.histogram_seconds = lap(phase);
+        this->stats_.histogram_measured = true;
+    }
+    const bool reuse = this->options_.reuse_tables && byte_codes && !shared;
+
+    this->ui_.write_message("Encoding blocks...");
+    std::vector<std::string> payloads(batch);
+    std::vector<block_type> types(batch);
+    // code table written before a block and the code it's coded with
+    std::vector<std::string> tables(batch);
+    std::vector<block_type> table_types(batch);
+    std::vector<std::shared_ptr<const shared_code>> codes(batch, shared);
+    std::vector<freq_map> maps(batch);
+    std::vector<std::future<uint64_t>> tasks;
+    if (this->options_.stored && input_file.raw() && output_file.raw())
     {
-        if (uint64_t frq = map.get(static_cast<uint8_t>(chr)))
+        // stored blocks are copied between the files by the kernel, the
+        // buffer isn't used and the loop below finds the input at its end
+        input_file.sync();
+        while (this->stats_.original_size < progress_total)
         {
-            output_file.write(reinterpret_cast<char *>(&chr), sizeof(uint8_t));
-            output_file.write(reinterpret_cast<char *>(&frq), sizeof(uint64_t));
+            const auto size = static_cast<uint32_t>(std::min<uint64_t>(
+                block_size, progress_total - this->stats_.original_size));
+            write_block_header(output_file, block_type::STORED, size, size);
+            output_file.flush();
+            if (input_file.raw()->copy_to(*output_file.raw(), size) != size)
+            {
+                this->remove_output(output_file);
+                this->ui_.app_error("Cannot copy input to output file.");
+                return false;
+            }
+            this->stats_.original_size += size;
+            this->stats_.encoded_bits += static_cast<uint64_t>(size) * CHAR_BIT;
+
+            if (this->cancelled(this->stats_.original_size, progress_total,
+                                output_file))
+                return false;
         }
     }
+    while (input_file.good())
+    {
+        input_file.read(reinterpret_cast<char *>(this->buffer_),
+                        static_cast<std::streamsize>(batch * block_size));
+        this->buffer_cnt_ = static_cast<size_t>(input_file.gcount());
+        if (this->buffer_cnt_ == 0)
+            break;
 
-	//add padding bytes
-    for (uint8_t i = 0; i < padding; i++)
-        wrapper << 0;
-    // no need to flush it here
-    // flushing will cause problems
-	// because we will write more zeros
+        const size_t blocks = (this->buffer_cnt_ + block_size - 1) / block_size;
+        if (this->options_.stored)
+        {
+            // stored blocks are written straight from the buffer
+            for (size_t i = 0; i < blocks; i++)
+            {
+                const size_t begin = i * block_size;
+                const size_t size =
+                    std::min(block_size, this->buffer_cnt_ - begin);
+                write_block_header(output_file, block_type::STORED,
+                                   static_cast<uint32_t>(size),
+                                   static_cast<uint32_t>(size));
+                output_file.write(
+                    reinterpret_cast<char *>(this->buffer_ + begin),
+                    static_cast<std::streamsize>(size));
+            }
+            this->stats_.encoded_bits += this->buffer_cnt_ * CHAR_BIT;
+        }
+        else
+        {
+            if (reuse)
+            {
+                // codes of blocks are built in parallel, then in order every
+                // block keeps the previous table or writes a delta of it
+                auto build = [this, &codec, &maps, block_size](const size_t i)
+                {
+                    const size_t begin = i * block_size;
+                    maps[i] = freq_map(UINT8_MAX + 1);
+                    return codec.byte_code(
+                        this->buffer_ + begin,
+                        std::min(block_size, this->buffer_cnt_ - begin),
+                        maps[i]);
+                };
+                std::vector<std::future<canonical_code>> built;
+                for (size_t i = 0; i < blocks; i++)
+                    built.push_back(std::async(std::launch::async, build, i));
+                for (size_t i = 0; i < blocks; i++)
+                {
+                    canonical_code code = built[i].get();
+                    const size_t begin = i * block_size;
+                    const size_t size =
+                        std::min(block_size, this->buffer_cnt_ - begin);
+                    tables[i].clear();
+                    if (!shared ||
+                        !codec.reuses_table(shared->code, code, maps[i], size))
+                    {
+                        table_types[i] = shared ? block_type::DELTA_TABLE
+                                                : block_type::CODE_TABLE;
+                        block_codec::encode_table(
+                            code, tables[i], shared ? &shared->code : nullptr);
+                        shared = std::make_shared<const shared_code>(
+                            std::move(code),
+                            block_size >= huffman_kernels::pair_codes_min_size);
+                    }
+                    codes[i] = shared;
+                }
+            }
+
+            // first block is coded by this thread
+            auto encode = [this, &codec, &codes, &payloads, &types,
+                           block_size](const size_t i)
+            {
+                const size_t begin = i * block_size;
+                const size_t size =
+                    std::min(block_size, this->buffer_cnt_ - begin);
+                if (codes[i])
+                    return codec.encode(*codes[i], this->buffer_ + begin, size,
+                                        payloads[i], types[i]);
+                return codec.encode(this->buffer_ + begin, size, payloads[i],
+                                    types[i]);
+            };
+            tasks.clear();
+            for (size_t i = 1; i < blocks; i++)
+                tasks.push_back(std::async(std::launch::async, encode, i));
+            this->stats_.encoded_bits += encode(0);
+            for (auto &task : tasks)
+                this->stats_.encoded_bits += task.get();
+
+            for (size_t i = 0; i < blocks; i++)
+            {
+                if (!tables[i].empty())
+                    write_table_block(output_file, table_types[i], tables[i]);
+                const size_t size =
+                    std::min(block_size, this->buffer_cnt_ - i * block_size);
+                write_block_header(output_file, types[i],
+                                   static_cast<uint32_t>(size),
+                                   static_cast<uint32_t>(payloads[i].size()));
+                output_file.write(
+                    payloads[i].data(),
+                    static_cast<std::streamsize>(payloads[i].size()));
+            }
+        }
+        this->stats_.original_size += this->buffer_cnt_;
+
+        if (this->cancelled(this->stats_.original_size, progress_total,
+                            output_file))
+            return false;
+    }
+    // a read error or an input shortened while it was read would otherwise
+    // end in a well-formed but truncated file
+    if (input_file.bad() || this->stats_.original_size < progress_total)
+    {
+        this->remove_output(output_file);
+        this->ui_.app_error("Cannot read input file.");
+        return false;
+    }
+    write_block_header(output_file, block_type::END, 0, 0);
+    // input grew while it was read
+    if (this->stats_.original_size != progress_total)
+        update_original_size(output_file, this->stats_.original_size);
+    this->stats_.transform_seconds = lap(phase);
+
+    output_file.flush();
+    this->stats_.compressed_size = static_cast<uint64_t>(output_file.tellp());
+    this->stats_.flush_seconds = lap(phase);
+
+    this->stats_.encoded_bits_measured = true;
+    if (this->stats_.original_size)
+        this->stats_.average_code_length =
+            static_cast<double>(this->stats_.encoded_bits) /
+            static_cast<double>(this->stats_.original_size);
+    this->stats_.bytes_in = this->stats_.original_size;
+    this->stats_.bytes_out = this->stats_.compressed_size;
+    return true;
 }
 
-static huffman_tree *read_file_header(std::fstream &file, bit_file_io &wrapper)
+/**
+ * @brief Decodes blocks up to the end block, batches of blocks are decoded
+ * in parallel. Blocks have to add up to original_size, unless it's
+ * unknown_size. Returns false when ui asked to stop, throws std::logic_error
+ * on corrupted input
+ */
+bool huffman_encoder::decompress_blocks(file_stream &input_file,
+                                        file_stream &output_file,
+                                        const block_pipeline pipeline,
+                                        const uint64_t original_size)
 {
-    uint8_t header[2];
-    // header[0] -> num of unique bytes - 1
-    // header[1] -> code padding
+    auto phase = stats_clock::now();
+    compression_options options = this->options_;
+    options.pipeline = pipeline;
+    const block_codec codec(options);
+    const size_t batch = blocks_per_batch(options, this->buffer_size_, 1);
+
+    this->ui_.write_message("Decoding blocks...");
+    std::vector<std::string> payloads(batch);
+    std::vector<block_type> types(batch);
+    std::vector<std::vector<uint8_t>> blocks(batch);
+    // code of the last table block, every block keeps the one it needs
+    std::shared_ptr<const shared_code> shared;
+    std::vector<std::shared_ptr<const shared_code>> codes(batch);
+    std::vector<std::future<void>> tasks;
+    // stored blocks are copied between the files by the kernel, after the
+    // blocks before them are written
+    const bool copy = input_file.raw() && output_file.raw();
+    // blocks can't decode to more bytes than the header says
+    uint64_t bytes_left = original_size;
+    bool end = false;
+    while (!end)
+    {
+        size_t count = 0;
+        uint32_t size = 0, payload_size = 0, stored = 0;
+        while (count < batch &&
+               !(end = (types[count] = read_block_header(
+                            input_file, size, payload_size)) == block_type::END))
+        {
+            if (size > this->buffer_size_ ||
+                payload_size > block_codec::max_payload_size(size))
+                throw std::logic_error("Invalid block header.");
+            if (original_size != unknown_size)
+            {
+                if (size > bytes_left)
+                    throw std::logic_error("Compressed data is corrupted.");
+                bytes_left -= size;
+            }
+            if (copy && types[count] == block_type::STORED)
+            {
+                if (payload_size != size)
+                    throw std::logic_error("Compressed data is corrupted.");
+                stored = size;
+                break;
+            }
 
-	//read header to header array
-    file.read(reinterpret_cast<char *>(&header), sizeof(header));
-    const uint16_t unique_bytes = static_cast<uint16_t>(header[0]) + 1;
-    freq_map map;
+            payloads[count].resize(payload_size);
+            if (!input_file.read(&payloads[count][0],
+                                 static_cast<std::streamsize>(payload_size)))
+                throw std::logic_error("File is truncated.");
+            if (types[count] == block_type::CODE_TABLE)
+            {
+                shared = block_codec::decode_table(payloads[count]);
+                continue;
+            }
+            if (types[count] == block_type::DELTA_TABLE)
+            {
+                if (!shared)
+                    throw std::logic_error("Compressed data is corrupted.");
+                shared = block_codec::decode_table(payloads[count],
+                                                   shared.get());
+                continue;
+            }
+            blocks[count].resize(size);
+            codes[count] = shared;
+            count++;
+        }
+
+        auto decode = [&codec, &payloads, &types, &blocks,
+                       &codes](const size_t i)
+        {
+            codec.decode(types[i], payloads[i], blocks[i].data(),
+                         blocks[i].size(), codes[i].get());
+        };
+        tasks.clear();
+        for (size_t i = 1; i < count; i++)
+            tasks.push_back(std::async(std::launch::async, decode, i));
+        if (count > 0)
+            decode(0);
+        // every task has to finish before blocks are reused, the first
+        // error is rethrown after that
+        std::exception_ptr error;
+        for (auto &task : tasks)
+        {
+            try
+            {
+                task.get();
+            }
+            catch (...)
+            {
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+        if (error)
+            std::rethrow_exception(error);
 
-	uint8_t byte = 0;
-    uint64_t count = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            output_file.write(reinterpret_cast<char *>(blocks[i].data()),
+                              static_cast<std::streamsize>(blocks[i].size()));
+            this->stats_.original_size += blocks[i].size();
+        }
+        if (stored > 0)
+        {
+            output_file.flush();
+            input_file.sync();
+            if (input_file.raw()->copy_to(*output_file.raw(), stored) != stored)
+                throw std::logic_error("File is truncated.");
+            this->stats_.original_size += stored;
+        }
 
-	//how many bytes are read
-    uint16_t bytes_read = 2;
+        if (this->cancelled(static_cast<uint64_t>(input_file.tellg()),
+                            this->stats_.compressed_size, output_file))
+            return false;
+    }
+    if (original_size != unknown_size && bytes_left != 0)
+        throw std::logic_error("File is truncated.");
+    this->stats_.transform_seconds = lap(phase);
+
+    this->stats_.bytes_in = this->stats_.compressed_size;
+    this->stats_.bytes_out = this->stats_.original_size;
+    return true;
+}
+
+void huffman_encoder::analyze_file()
+{
+    const auto started = stats_clock::now();
+    auto phase = started;
+    this->stats_ = huffman_stats();
+    this->stats_.operation = "analyze";
 
-	//read bytes frequency
-    while (bytes_read < ((unique_bytes * 9) + 2) &&
-           file.read(reinterpret_cast<char *>(&byte), sizeof(uint8_t)) &&
-           file.read(reinterpret_cast<char *>(&count), sizeof(uint64_t)))
+    this->ui_.write_message("Starting analysis...");
+    file_stream input_file(this->input_file_, false, this->io_mode_);
+    if (!input_file.good() ||
+        input_file.peek() == std::ifstream::traits_type::eof())
     {
-        bytes_read += 9;
-        map.set(byte, count);
+        input_file.close();
+        this->ui_.app_error("Input file doesn't exists, or it's empty.");
+        return;
     }
 
-	//read padding bits
-    uint8_t bit;
-    for (uint8_t i = 0; i < header[1] && wrapper >> bit; i++)
-        ;
+    input_file.seekg(0, std::ios_base::end);
+    const uint64_t progress_total = static_cast<uint64_t>(input_file.tellg());
+    input_file.seekg(0, std::ios_base::beg);
+    uint64_t progress = 0;
+
+    freq_map map;
+    if (!this->count_frequency(input_file, map, progress, progress_total))
+    {
+        this->ui_.app_error("Analysis cancelled.");
+        return;
+    }
+    // a read error ends the histogram early, its size would be wrong
+    if (input_file.bad())
+    {
+        input_file.close();
+        this->ui_.app_error("Cannot read input file.");
+        return;
+    }
+    input_file.close();
+    this->stats_.histogram_seconds = lap(phase);
+    this->stats_.histogram_measured = true;
+
+    const huffman_tree tree(map);
+    this->stats_.tree_build_seconds = lap(phase);
+    this->stats_.set_code_stats(map, tree);
+
+    // same layout as written by compress_file, padding fills the last byte
+    this->stats_.original_size = map.total();
+    const uint64_t header_size =
+        2 + map.size() * (sizeof(uint8_t) + sizeof(uint64_t));
+    this->stats_.compressed_size =
+        header_size + (this->stats_.encoded_bits + CHAR_BIT - 1) / CHAR_BIT;
+    this->stats_.bytes_in = this->stats_.original_size;
+    this->stats_.total_seconds = seconds_since(started);
+
+    std::stringstream ss;
+    ss << "Unique bytes: " << map.size();
+    this->ui_.write_message(ss.str());
+    ss.str(std::string());
+    ss << "Original size: " << this->stats_.original_size << " bytes";
+    this->ui_.write_message(ss.str());
+    ss.str(std::string());
+    ss << "Compressed size: " << this->stats_.compressed_size << " bytes (ratio "
+       << this->stats_.compression_ratio() << ")";
+    this->ui_.write_message(ss.str());
+    ss.str(std::string());
+    ss << "Entropy: " << this->stats_.entropy
+       << " bits/byte, average code length: "
+       << this->stats_.average_code_length << " bits/byte";
+    this->ui_.write_message(ss.str());
+    ss.str(std::string());
+
+    this->ui_.write_message("Code lengths:");
+    for (uint16_t chr = 0; chr <= UINT8_MAX; chr++)
+    {
+        if (const uint64_t freq = map.get(static_cast<uint8_t>(chr)))
+        {
+            ss << "\t0x" << std::hex << std::setw(2) << std::setfill('0')
+               << chr << std::dec << " - "
+               << static_cast<unsigned>(this->stats_.code_lengths[chr])
+               << " bits, " << freq << " times";
+            this->ui_.write_message(ss.str());
+            ss.str(std::string());
+        }
+    }
 
-	//construct tree
-    return new huffman_tree(map);
+    this->ui_.write_message("Analysis finished");
 }
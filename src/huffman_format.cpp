@@ -0,0 +1,213 @@
+﻿#include "../inc/huffman_format.h"
+
+#include <climits>
+#include <stdexcept>
+
+uint8_t code_padding(const freq_map &map, const huffman_tree &tree)
+{
+    const auto codes = tree.get_codes();
+
+	//code may not be length mult of 8
+	//in this case we should add padding before code
+    uint8_t padding = 0;
+    for (uint16_t i = 0; i <= UINT8_MAX; i++)
+    {
+		padding = (padding + ((codes[i].size() % CHAR_BIT) *
+			(map.get(static_cast<uint8_t>(i)) % CHAR_BIT)) %
+			CHAR_BIT) %
+			CHAR_BIT;
+    }
+
+	return padding > 0 ? CHAR_BIT - padding : 0;
+}
+
+void write_file_header(const freq_map &map, const uint8_t padding,
+                       std::iostream &output_file, bit_file_io &wrapper)
+{
+    uint8_t buf[2] = {
+        static_cast<uint8_t>(map.size() -
+                             1), // bytes_size + 1 = unique bytes count;
+        padding                  // needed padding for huffman code
+    };
+
+    output_file.write(reinterpret_cast<char *>(&buf), sizeof(buf));
+
+	//write bytes frequency
+    for (uint16_t chr = 0; chr <= UINT8_MAX; chr++)
+    {
+        if (uint64_t frq = map.get(static_cast<uint8_t>(chr)))
+        {
+            output_file.write(reinterpret_cast<char *>(&chr), sizeof(uint8_t));
+            output_file.write(reinterpret_cast<char *>(&frq), sizeof(uint64_t));
+        }
+    }
+
+	//add padding bytes
+    for (uint8_t i = 0; i < padding; i++)
+        wrapper << 0;
+    // no need to flush it here
+    // flushing will cause problems
+	// because we will write more zeros
+}
+
+huffman_tree *read_file_header(std::iostream &file, bit_file_io &wrapper,
+                               freq_map &map)
+{
+    uint8_t header[2];
+    // header[0] -> num of unique bytes - 1
+    // header[1] -> code padding
+
+    //read header to header array
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+        throw std::logic_error("File header is truncated.");
+    const uint16_t unique_bytes = static_cast<uint16_t>(header[0]) + 1;
+    if (header[1] >= CHAR_BIT)
+        throw std::logic_error("Invalid file header.");
+
+    uint8_t byte = 0;
+    uint64_t count = 0, total = 0;
+
+    //read bytes frequency, every byte has to appear exactly once
+    //and the sum can't overflow
+    for (uint16_t i = 0; i < unique_bytes; i++)
+    {
+        if (!file.read(reinterpret_cast<char *>(&byte), sizeof(uint8_t)) ||
+            !file.read(reinterpret_cast<char *>(&count), sizeof(uint64_t)))
+            throw std::logic_error("File header is truncated.");
+        if (count == 0 || map.get(byte) != 0 || total + count < total)
+            throw std::logic_error("Invalid file header.");
+        total += count;
+        map.set(byte, count);
+    }
+
+    //read padding bits
+    uint8_t bit;
+    for (uint8_t i = 0; i < header[1]; i++)
+        if (!(wrapper >> bit))
+            throw std::logic_error("File header is truncated.");
+
+    //construct tree, padding has to match the codes
+    auto tree = new huffman_tree(map);
+    if (code_padding(map, *tree) != header[1])
+    {
+        delete tree;
+        throw std::logic_error("Invalid file header.");
+    }
+    return tree;
+}
+
+// block container: 'H' 'F' [version] [pipeline] [original size:64] then
+// blocks, version 1 has no original size
+static constexpr uint8_t container_magic[2] = {'H', 'F'};
+static constexpr uint8_t container_version = 2;
+static constexpr std::streamoff original_size_offset = 4;
+
+static void write_u32(std::ostream &file, const uint32_t value)
+{
+    uint8_t buf[sizeof(uint32_t)];
+    for (size_t i = 0; i < sizeof(uint32_t); i++)
+        buf[i] = static_cast<uint8_t>(value >> (i * CHAR_BIT));
+    file.write(reinterpret_cast<char *>(buf), sizeof(buf));
+}
+
+static bool read_u32(std::istream &file, uint32_t &value)
+{
+    uint8_t buf[sizeof(uint32_t)];
+    if (!file.read(reinterpret_cast<char *>(buf), sizeof(buf)))
+        return false;
+    value = 0;
+    for (size_t i = 0; i < sizeof(uint32_t); i++)
+        value |= static_cast<uint32_t>(buf[i]) << (i * CHAR_BIT);
+    return true;
+}
+
+static void write_u64(std::ostream &file, const uint64_t value)
+{
+    write_u32(file, static_cast<uint32_t>(value));
+    write_u32(file, static_cast<uint32_t>(value >> 32));
+}
+
+static bool read_u64(std::istream &file, uint64_t &value)
+{
+    uint32_t low = 0, high = 0;
+    if (!read_u32(file, low) || !read_u32(file, high))
+        return false;
+    value = static_cast<uint64_t>(high) << 32 | low;
+    return true;
+}
+
+void write_container_header(std::ostream &output_file,
+                            const block_pipeline pipeline,
+                            const uint64_t original_size)
+{
+    const uint8_t header[4] = {container_magic[0], container_magic[1],
+                               container_version,
+                               static_cast<uint8_t>(pipeline)};
+    output_file.write(reinterpret_cast<const char *>(header), sizeof(header));
+    write_u64(output_file, original_size);
+}
+
+void update_original_size(std::ostream &output_file,
+                          const uint64_t original_size)
+{
+    const auto end = output_file.tellp();
+    output_file.seekp(original_size_offset, std::ios_base::beg);
+    write_u64(output_file, original_size);
+    output_file.seekp(end);
+}
+
+bool read_container_header(std::istream &file, block_pipeline &pipeline,
+                           uint64_t &original_size)
+{
+    uint8_t header[4];
+    if (!file.read(reinterpret_cast<char *>(header), sizeof(header)) ||
+        header[0] != container_magic[0] || header[1] != container_magic[1])
+    {
+        // old format, its header is read from the beginning
+        file.clear();
+        file.seekg(0, std::ios_base::beg);
+        return false;
+    }
+
+    if (header[2] == 0 || header[2] > container_version ||
+        header[3] > static_cast<uint8_t>(block_pipeline::LZ77))
+        throw std::logic_error("Unsupported file format version.");
+    pipeline = static_cast<block_pipeline>(header[3]);
+    original_size = unknown_size;
+    if (header[2] > 1 && !read_u64(file, original_size))
+        throw std::logic_error("File is truncated.");
+    return true;
+}
+
+void write_block_header(std::ostream &output_file, const block_type type,
+                        const uint32_t size, const uint32_t payload_size)
+{
+    const auto type_byte = static_cast<uint8_t>(type);
+    output_file.write(reinterpret_cast<const char *>(&type_byte),
+                      sizeof(type_byte));
+    if (type == block_type::END)
+        return;
+    write_u32(output_file, size);
+    write_u32(output_file, payload_size);
+}
+
+block_type read_block_header(std::istream &file, uint32_t &size,
+                             uint32_t &payload_size)
+{
+    uint8_t type = 0;
+    size = payload_size = 0;
+    if (!file.read(reinterpret_cast<char *>(&type), sizeof(type)))
+        throw std::logic_error("File is truncated.");
+    if (type == static_cast<uint8_t>(block_type::END))
+        return block_type::END;
+    if (type > static_cast<uint8_t>(block_type::DELTA_TABLE))
+        throw std::logic_error("Invalid block header.");
+    if (!read_u32(file, size) || !read_u32(file, payload_size))
+        throw std::logic_error("File is truncated.");
+    // only code tables decode to no bytes
+    const bool table = type == static_cast<uint8_t>(block_type::CODE_TABLE) ||
+                       type == static_cast<uint8_t>(block_type::DELTA_TABLE);
+    if ((size == 0) != table)
+        throw std::logic_error("Invalid block header.");
+    return static_cast<block_type>(type);
+}
@@ -0,0 +1,594 @@
+﻿#include "../inc/huffman_kernels.h"
+
+#include "../inc/consts.h"
+#include "../inc/cpu_features.h"
+#include <stdexcept>
+
+// gcc/clang can compile the same kernels once more for BMI2/AVX2 capable
+// hosts, the variant is picked at runtime from cpu_features
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HUFFMAN_BMI2_KERNELS
+#define KERNEL_INLINE inline __attribute__((always_inline))
+#define KERNEL_TARGET_BMI2 __attribute__((target("bmi,bmi2,lzcnt,avx,avx2")))
+#else
+#define KERNEL_INLINE inline
+#endif
+
+// max code length covered by a single lookup of the decode table
+static constexpr uint8_t table_bits(const huffman_kernels::length_class cls)
+{
+    return cls == huffman_kernels::length_class::UP_TO_8    ? 8
+           : cls == huffman_kernels::length_class::UP_TO_12 ? 12
+                                                            : 16;
+}
+
+// four interleaved tables, so consecutive equal bytes don't wait for each
+// other's increments
+KERNEL_INLINE static void count_block(const uint8_t *data, const size_t size,
+                                      freq_map &map)
+{
+    // no table can get more than a chunk, so uint32_t can't overflow
+    constexpr size_t chunk_size = UINT32_MAX;
+
+    for (size_t begin = 0; begin < size; begin += chunk_size)
+    {
+        const size_t end = size - begin > chunk_size ? begin + chunk_size : size;
+        uint32_t counts[4][UINT8_MAX + 1] = {};
+
+        size_t i = begin;
+        for (; i + 4 <= end; i += 4)
+        {
+            counts[0][data[i]]++;
+            counts[1][data[i + 1]]++;
+            counts[2][data[i + 2]]++;
+            counts[3][data[i + 3]]++;
+        }
+        for (; i < end; i++)
+            counts[0][data[i]]++;
+
+        for (uint16_t byte = 0; byte <= UINT8_MAX; byte++)
+        {
+            const uint64_t sum = static_cast<uint64_t>(counts[0][byte]) +
+                                 counts[1][byte] + counts[2][byte] +
+                                 counts[3][byte];
+            if (sum)
+                map.set(static_cast<uint8_t>(byte),
+                        map.get(static_cast<uint8_t>(byte)) + sum);
+        }
+    }
+}
+
+// codes of bounded length, wide symbols read the separate vectors
+template <typename Symbol> struct code_lookup
+{
+    const uint64_t *code_bits;
+    const uint8_t *code_length;
+
+    explicit code_lookup(const huffman_code_tables &tables)
+        : code_bits(tables.code_bits.data()),
+          code_length(tables.code_length.data())
+    {
+    }
+
+    huffman_encode_entry operator[](const Symbol symbol) const
+    {
+        return {static_cast<uint32_t>(this->code_bits[symbol]),
+                this->code_length[symbol]};
+    }
+};
+
+// bytes read the packed table, one load per code
+template <> struct code_lookup<uint8_t>
+{
+    const huffman_encode_entry *byte_codes;
+
+    explicit code_lookup(const huffman_code_tables &tables)
+        : byte_codes(tables.byte_codes)
+    {
+    }
+
+    huffman_encode_entry operator[](const uint8_t symbol) const
+    {
+        return this->byte_codes[symbol];
+    }
+};
+
+// MaxLen bounds every code, so per_refill codes always fit in one
+// write_bits call and the inner loop has a constant trip count
+template <uint8_t MaxLen, typename Symbol>
+KERNEL_INLINE static void encode_block(const huffman_code_tables &tables,
+                                       const Symbol *data, const size_t size,
+                                       bit_file_io &out)
+{
+    constexpr size_t per_refill = bit_file_io::max_bits / MaxLen;
+    const code_lookup<Symbol> codes(tables);
+
+    size_t i = 0;
+    for (; i + per_refill <= size; i += per_refill)
+    {
+        uint64_t bits = 0;
+        uint8_t length = 0;
+        for (size_t k = 0; k < per_refill; k++)
+        {
+            const huffman_encode_entry code = codes[data[i + k]];
+            bits = (bits << code.length) | code.code;
+            length += code.length;
+        }
+        out.write_bits(bits, length);
+    }
+
+    for (; i < size; i++)
+    {
+        const huffman_encode_entry code = codes[data[i]];
+        out.write_bits(code.code, code.length);
+    }
+}
+
+// two bytes per lookup of pair_codes, the odd byte at the end goes through
+// encode_block
+template <uint8_t MaxLen>
+KERNEL_INLINE static void encode_pair_block(const huffman_code_tables &tables,
+                                            const uint8_t *data,
+                                            const size_t size,
+                                            bit_file_io &out)
+{
+    constexpr size_t per_refill = bit_file_io::max_bits / (2 * MaxLen) * 2;
+    const huffman_encode_entry *pair_codes = tables.pair_codes.data();
+
+    size_t i = 0;
+    for (; i + per_refill <= size; i += per_refill)
+    {
+        uint64_t bits = 0;
+        uint8_t length = 0;
+        for (size_t k = 0; k < per_refill; k += 2)
+        {
+            const huffman_encode_entry code =
+                pair_codes[data[i + k] | data[i + k + 1] << 8];
+            bits = (bits << code.length) | code.code;
+            length += code.length;
+        }
+        out.write_bits(bits, length);
+    }
+
+    encode_block<MaxLen>(tables, data + i, size - i, out);
+}
+
+// codes of any length, longer codes are written bit by bit
+template <typename Symbol>
+KERNEL_INLINE static void encode_general(const huffman_code_tables &tables,
+                                         const Symbol *data,
+                                         const size_t size, bit_file_io &out)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        const Symbol symbol = data[i];
+        if (tables.code_length[symbol] <= bit_file_io::max_bits)
+        {
+            out.write_bits(tables.code_bits[symbol],
+                           tables.code_length[symbol]);
+            continue;
+        }
+        for (const uint8_t bit : tables.codes[symbol])
+            out << bit;
+    }
+}
+
+// decode table of the symbol type, entries keep the symbol in the lower
+// half and the code length in the upper one
+static const uint16_t *decode_entries(const huffman_code_tables &tables,
+                                      const uint8_t *)
+{
+    return tables.decode_table.data();
+}
+
+static const uint32_t *decode_entries(const huffman_code_tables &tables,
+                                      const uint16_t *)
+{
+    return tables.wide_decode_table.data();
+}
+
+// each refill provides enough bits for per_refill lookups of TableBits
+template <uint8_t TableBits, typename Symbol>
+KERNEL_INLINE static void decode_block(const huffman_code_tables &tables,
+                                       bit_file_io &in, Symbol *out,
+                                       const size_t count)
+{
+    constexpr size_t per_refill = bit_file_io::max_bits / TableBits;
+    constexpr uint8_t shift = sizeof(Symbol) * 8;
+    const auto table = decode_entries(tables, out);
+
+    // valid entries have non zero length, so they are >= 1 << shift. It's
+    // checked once at the end instead of branching on every symbol
+    int32_t invalid = 0;
+
+    size_t i = 0;
+    for (; i + per_refill <= count; i += per_refill)
+    {
+        in.refill();
+        for (size_t k = 0; k < per_refill; k++)
+        {
+            const auto entry = table[in.peek_bits(TableBits)];
+            invalid |= static_cast<int32_t>(entry) - (1 << shift);
+            out[i + k] = static_cast<Symbol>(entry);
+            in.skip_bits(static_cast<uint8_t>(entry >> shift));
+        }
+    }
+
+    for (; i < count; i++)
+    {
+        in.refill();
+        const auto entry = table[in.peek_bits(TableBits)];
+        invalid |= static_cast<int32_t>(entry) - (1 << shift);
+        out[i] = static_cast<Symbol>(entry);
+        in.skip_bits(static_cast<uint8_t>(entry >> shift));
+    }
+
+    if (invalid < 0)
+        throw std::logic_error("Compressed data is corrupted.");
+}
+
+// walks the tree or the canonical code bit by bit, works for codes of any
+// length
+template <typename Symbol>
+static void decode_general(const huffman_code_tables &tables, bit_file_io &in,
+                           Symbol *out, const size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (tables.root == nullptr)
+        {
+            // canonical codes of one length are consecutive numbers
+            uint64_t code = 0;
+            for (size_t length = 1;; length++)
+            {
+                if (length >= tables.first_code.size())
+                    throw std::logic_error("Compressed data is corrupted.");
+                uint8_t bit = 0;
+                if (!(in >> bit))
+                    throw std::logic_error("Compressed data is truncated.");
+                code = (code << 1) | bit;
+                const uint64_t offset = code - tables.first_code[length];
+                if (code >= tables.first_code[length] &&
+                    offset < tables.length_count[length])
+                {
+                    out[i] = static_cast<Symbol>(
+                        tables.sorted_symbols[tables.first_index[length] +
+                                              offset]);
+                    break;
+                }
+            }
+            continue;
+        }
+
+        const huffman_node *node = tables.root;
+        const huffman_leaf *leaf;
+        while ((leaf = dynamic_cast<const huffman_leaf *>(node)) == nullptr)
+        {
+            uint8_t bit = 0;
+            if (!(in >> bit))
+                throw std::logic_error("Compressed data is truncated.");
+            node = bit ? node->get_right_child() : node->get_left_child();
+            if (node == nullptr)
+                throw std::logic_error("Compressed data is corrupted.");
+        }
+        out[i] = static_cast<Symbol>(leaf->get_value());
+    }
+}
+
+static void count_scalar(const uint8_t *data, const size_t size, freq_map &map)
+{
+    count_block(data, size, map);
+}
+
+// MaxLen 0 selects the general kernels
+template <uint8_t MaxLen, typename Symbol>
+static void encode_scalar(const huffman_code_tables &tables,
+                          const Symbol *data, const size_t size,
+                          bit_file_io &out)
+{
+    if constexpr (MaxLen == 0)
+        encode_general(tables, data, size, out);
+    else
+        encode_block<MaxLen>(tables, data, size, out);
+}
+
+template <uint8_t MaxLen>
+static void encode_pairs_scalar(const huffman_code_tables &tables,
+                                const uint8_t *data, const size_t size,
+                                bit_file_io &out)
+{
+    encode_pair_block<MaxLen>(tables, data, size, out);
+}
+
+template <uint8_t TableBits, typename Symbol>
+static void decode_scalar(const huffman_code_tables &tables, bit_file_io &in,
+                          Symbol *out, const size_t count)
+{
+    if constexpr (TableBits == 0)
+        decode_general(tables, in, out, count);
+    else
+        decode_block<TableBits>(tables, in, out, count);
+}
+
+#ifdef HUFFMAN_BMI2_KERNELS
+// same kernels, the compiler is free to use shlx/shrx/bzhi for the variable
+// shifts and AVX2 for merging the histogram tables
+KERNEL_TARGET_BMI2 static void count_bmi2(const uint8_t *data,
+                                          const size_t size, freq_map &map)
+{
+    count_block(data, size, map);
+}
+
+template <uint8_t MaxLen, typename Symbol>
+KERNEL_TARGET_BMI2 static void encode_bmi2(const huffman_code_tables &tables,
+                                           const Symbol *data,
+                                           const size_t size, bit_file_io &out)
+{
+    if constexpr (MaxLen == 0)
+        encode_general(tables, data, size, out);
+    else
+        encode_block<MaxLen>(tables, data, size, out);
+}
+
+template <uint8_t MaxLen>
+KERNEL_TARGET_BMI2 static void
+encode_pairs_bmi2(const huffman_code_tables &tables, const uint8_t *data,
+                  const size_t size, bit_file_io &out)
+{
+    encode_pair_block<MaxLen>(tables, data, size, out);
+}
+
+// general decoding is bit by bit, so there's nothing to gain from BMI2
+template <uint8_t TableBits, typename Symbol>
+KERNEL_TARGET_BMI2 static void decode_bmi2(const huffman_code_tables &tables,
+                                           bit_file_io &in, Symbol *out,
+                                           const size_t count)
+{
+    if constexpr (TableBits == 0)
+        decode_general(tables, in, out, count);
+    else
+        decode_block<TableBits>(tables, in, out, count);
+}
+#endif
+
+// picks kernels of one symbol type for the length class
+template <uint8_t Bits, typename Symbol>
+static void select_variant(const bool bmi2,
+                           void (*&encode)(const huffman_code_tables &,
+                                           const Symbol *, size_t,
+                                           bit_file_io &),
+                           void (*&decode)(const huffman_code_tables &,
+                                           bit_file_io &, Symbol *, size_t))
+{
+#ifdef HUFFMAN_BMI2_KERNELS
+    encode = bmi2 ? encode_bmi2<Bits, Symbol> : encode_scalar<Bits, Symbol>;
+    decode = bmi2 ? decode_bmi2<Bits, Symbol> : decode_scalar<Bits, Symbol>;
+#else
+    UNUSED(bmi2);
+    encode = encode_scalar<Bits, Symbol>;
+    decode = decode_scalar<Bits, Symbol>;
+#endif
+}
+
+template <typename Symbol>
+static void select_for_class(const huffman_kernels::length_class cls,
+                             const bool bmi2,
+                             void (*&encode)(const huffman_code_tables &,
+                                             const Symbol *, size_t,
+                                             bit_file_io &),
+                             void (*&decode)(const huffman_code_tables &,
+                                             bit_file_io &, Symbol *, size_t))
+{
+    switch (cls)
+    {
+    case huffman_kernels::length_class::UP_TO_8:
+        select_variant<8>(bmi2, encode, decode);
+        break;
+    case huffman_kernels::length_class::UP_TO_12:
+        select_variant<12>(bmi2, encode, decode);
+        break;
+    case huffman_kernels::length_class::UP_TO_16:
+        select_variant<16>(bmi2, encode, decode);
+        break;
+    case huffman_kernels::length_class::GENERAL:
+    default:
+        select_variant<0>(bmi2, encode, decode);
+        break;
+    }
+}
+
+// every code is a prefix of 2^(bits - length) table entries
+template <typename Entry>
+static void fill_decode_table(const huffman_code_tables &tables,
+                              const uint8_t bits, std::vector<Entry> &table)
+{
+    constexpr uint8_t shift = sizeof(Entry) * 4;
+    table.assign(static_cast<size_t>(1) << bits, 0);
+    for (size_t i = 0; i < tables.code_length.size(); i++)
+    {
+        const uint8_t length = tables.code_length[i];
+        if (length == 0)
+            continue;
+        const size_t first = tables.code_bits[i] << (bits - length);
+        const size_t last = first + (static_cast<size_t>(1) << (bits - length));
+        for (size_t j = first; j < last; j++)
+            table[j] = static_cast<Entry>(
+                (static_cast<Entry>(length) << shift) | i);
+    }
+}
+
+huffman_kernels::huffman_kernels(const huffman_tree &tree,
+                                 const instruction_set isa,
+                                 const length_class min_class)
+    : instruction_set_(isa)
+{
+    const auto codes = tree.get_codes();
+    const size_t alphabet_size = UINT8_MAX + 1;
+    this->tables_.codes = codes;
+    this->tables_.root = tree.get_root();
+    this->tables_.code_bits.assign(alphabet_size, 0);
+    this->tables_.code_length.assign(alphabet_size, 0);
+    for (size_t i = 0; i < alphabet_size; i++)
+    {
+        this->tables_.code_length[i] = static_cast<uint8_t>(codes[i].size());
+        if (codes[i].size() > bit_file_io::max_bits)
+            continue;
+        for (const uint8_t bit : codes[i])
+            this->tables_.code_bits[i] = (this->tables_.code_bits[i] << 1) | bit;
+    }
+
+    this->select_kernels(tree.get_max_code_length(), min_class);
+}
+
+huffman_kernels::huffman_kernels(const canonical_code &code,
+                                 const instruction_set isa,
+                                 const length_class min_class)
+    : instruction_set_(isa)
+{
+    const auto &lengths = code.get_lengths();
+    this->tables_.code_bits = code.get_codes();
+    this->tables_.code_length = lengths;
+
+    // symbols sorted by code length and value, canonical codes of one length
+    // follow that order
+    const uint8_t max_length = code.get_max_length();
+    this->tables_.first_code.assign(max_length + 1, 0);
+    this->tables_.first_index.assign(max_length + 1, 0);
+    this->tables_.length_count.assign(max_length + 1, 0);
+    for (const uint8_t length : lengths)
+        if (length)
+            this->tables_.length_count[length]++;
+    uint32_t index = 0;
+    for (uint8_t length = 1; length <= max_length; length++)
+    {
+        this->tables_.first_index[length] = index;
+        index += this->tables_.length_count[length];
+    }
+    this->tables_.sorted_symbols.assign(index, 0);
+    std::vector<uint32_t> next(this->tables_.first_index);
+    for (size_t i = 0; i < lengths.size(); i++)
+    {
+        if (lengths[i] == 0)
+            continue;
+        const uint32_t position = next[lengths[i]]++;
+        this->tables_.sorted_symbols[position] = static_cast<uint16_t>(i);
+        if (position == this->tables_.first_index[lengths[i]])
+            this->tables_.first_code[lengths[i]] = this->tables_.code_bits[i];
+    }
+
+    this->select_kernels(max_length, min_class);
+}
+
+void huffman_kernels::select_kernels(const uint16_t max_length,
+                                     const length_class min_class)
+{
+    if (max_length <= 8)
+        this->length_class_ = length_class::UP_TO_8;
+    else if (max_length <= 12)
+        this->length_class_ = length_class::UP_TO_12;
+    else if (max_length <= 16)
+        this->length_class_ = length_class::UP_TO_16;
+    else
+        this->length_class_ = length_class::GENERAL;
+    if (min_class > this->length_class_)
+        this->length_class_ = min_class;
+
+#ifndef HUFFMAN_BMI2_KERNELS
+    this->instruction_set_ = instruction_set::SCALAR;
+#endif
+    const bool bmi2 = this->instruction_set_ == instruction_set::BMI2_AVX2;
+
+    if (this->is_wide())
+        select_for_class(this->length_class_, bmi2, this->encode_symbols_,
+                         this->decode_symbols_);
+    else
+        select_for_class(this->length_class_, bmi2, this->encode_,
+                         this->decode_);
+
+    if (this->length_class_ == length_class::GENERAL)
+        return;
+    // alphabets below 256 symbols, like LZ77 distances, leave the rest of
+    // the table empty
+    if (!this->is_wide())
+        for (size_t i = 0; i <= UINT8_MAX; i++)
+            this->tables_.byte_codes[i] =
+                i < this->tables_.code_length.size()
+                    ? huffman_encode_entry{
+                          static_cast<uint32_t>(this->tables_.code_bits[i]),
+                          this->tables_.code_length[i]}
+                    : huffman_encode_entry{};
+    const uint8_t bits = table_bits(this->length_class_);
+    if (this->is_wide())
+        fill_decode_table(this->tables_, bits, this->tables_.wide_decode_table);
+    else
+        fill_decode_table(this->tables_, bits, this->tables_.decode_table);
+}
+
+bool huffman_kernels::enable_pair_codes()
+{
+    if (this->is_wide() || this->length_class_ > length_class::UP_TO_12)
+        return false;
+
+    // codes of both bytes take at most 24 bits
+    const huffman_encode_entry *byte_codes = this->tables_.byte_codes;
+    this->tables_.pair_codes.resize((UINT8_MAX + 1) * (UINT8_MAX + 1));
+    for (size_t second = 0; second <= UINT8_MAX; second++)
+        for (size_t first = 0; first <= UINT8_MAX; first++)
+            this->tables_.pair_codes[first | second << 8] = {
+                byte_codes[first].code << byte_codes[second].length |
+                    byte_codes[second].code,
+                static_cast<uint8_t>(byte_codes[first].length +
+                                     byte_codes[second].length)};
+
+    const bool up_to_8 = this->length_class_ == length_class::UP_TO_8;
+#ifdef HUFFMAN_BMI2_KERNELS
+    if (this->instruction_set_ == instruction_set::BMI2_AVX2)
+    {
+        this->encode_ = up_to_8 ? encode_pairs_bmi2<8> : encode_pairs_bmi2<12>;
+        return true;
+    }
+#endif
+    this->encode_ = up_to_8 ? encode_pairs_scalar<8> : encode_pairs_scalar<12>;
+    return true;
+}
+
+huffman_kernels::instruction_set huffman_kernels::best_instruction_set()
+{
+    const cpu_features &features = cpu_features::get();
+    return features.has_bmi2() && features.has_avx2()
+               ? instruction_set::BMI2_AVX2
+               : instruction_set::SCALAR;
+}
+
+void huffman_kernels::count_bytes(const uint8_t *data, const size_t size,
+                                  freq_map &map, const instruction_set isa)
+{
+#ifdef HUFFMAN_BMI2_KERNELS
+    if (isa == instruction_set::BMI2_AVX2)
+    {
+        count_bmi2(data, size, map);
+        return;
+    }
+#else
+    UNUSED(isa);
+#endif
+    count_scalar(data, size, map);
+}
+
+void huffman_kernels::decode(bit_file_io &in, uint8_t *out,
+                             const size_t count) const
+{
+    this->decode_(this->tables_, in, out, count);
+
+    if (in.overrun())
+        throw std::logic_error("Compressed data is truncated.");
+}
+
+void huffman_kernels::decode_symbols(bit_file_io &in, uint16_t *out,
+                                     const size_t count) const
+{
+    this->decode_symbols_(this->tables_, in, out, count);
+
+    if (in.overrun())
+        throw std::logic_error("Compressed data is truncated.");
+}
@@ -0,0 +1,788 @@
+﻿#include "../inc/huffman_server.h"
+
+#include "../inc/bit_file_io.h"
+#include "../inc/block_codec.h"
+#include "../inc/consts.h"
+#include "../inc/huffman_encoder.h"
+#include "../inc/huffman_format.h"
+#include "../inc/huffman_kernels.h"
+#include "../inc/huffman_tree.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#endif
+
+using stats_clock = std::chrono::steady_clock;
+
+// larger payloads are refused, they are kept in memory twice, larger data
+// goes through the file requests
+static constexpr uint64_t max_payload_size = 64ULL << 20;
+// longest request line, paths included
+static constexpr size_t max_line_length = 4096;
+// connections stalled this long inside a request are closed
+static constexpr int request_timeout_s = 30;
+// bytes asked from the socket at once
+static constexpr size_t receive_size = 65536;
+// larger request buffers are freed once their request is answered
+static constexpr size_t kept_buffer_size = 4 << 20;
+// code tables of earlier requests kept by every worker
+static constexpr size_t cached_tables = 16;
+
+std::string server_stats::to_json() const
+{
+    std::ostringstream ss;
+    ss << "{\"requests\":" << this->requests << ",\"errors\":" << this->errors
+       << ",\"bytes_in\":" << this->bytes_in
+       << ",\"bytes_out\":" << this->bytes_out
+       << ",\"latency_ms\":{\"p50\":" << this->p50_ms
+       << ",\"p90\":" << this->p90_ms << ",\"p99\":" << this->p99_ms
+       << ",\"max\":" << this->max_ms << "}}";
+    return ss.str();
+}
+
+namespace
+{
+
+// ui of one worker, errors are kept for the response instead of ending the
+// program and messages are dropped
+class server_ui final : public ui
+{
+  private:
+    mutable std::string error_;
+
+  public:
+    void write_message(const std::string &msg) const override { UNUSED(msg); }
+    void app_error(const std::string &error_msg) const override
+    {
+        if (this->error_.empty())
+            this->error_ = error_msg;
+    }
+
+    const std::string &error() const { return this->error_; }
+    void clear() { this->error_.clear(); }
+};
+
+// reads data in place and appends written bytes to a string, so the
+// container functions work on request buffers without copying them
+class memory_buf final : public std::streambuf
+{
+  private:
+    std::string &output_;
+
+  protected:
+    int_type overflow(int_type ch) override
+    {
+        if (!traits_type::eq_int_type(ch, traits_type::eof()))
+            this->output_.push_back(traits_type::to_char_type(ch));
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(const char *data, std::streamsize count) override
+    {
+        this->output_.append(data, static_cast<size_t>(count));
+        return count;
+    }
+
+    pos_type seekoff(off_type offset, std::ios_base::seekdir dir,
+                     std::ios_base::openmode which) override
+    {
+        if (!(which & std::ios_base::in))
+            return pos_type(off_type(-1));
+        const off_type end = this->egptr() - this->eback();
+        if (dir == std::ios_base::cur)
+            offset += this->gptr() - this->eback();
+        else if (dir == std::ios_base::end)
+            offset += end;
+        if (offset < 0 || offset > end)
+            return pos_type(off_type(-1));
+        this->setg(this->eback(), this->eback() + offset, this->egptr());
+        return pos_type(offset);
+    }
+
+    pos_type seekpos(pos_type position, std::ios_base::openmode which) override
+    {
+        return this->seekoff(off_type(position), std::ios_base::beg, which);
+    }
+
+  public:
+    explicit memory_buf(std::string &output) : output_(output) {}
+
+    memory_buf(const std::string &input, std::string &output)
+        : output_(output)
+    {
+        // the get area is only read
+        char *data = const_cast<char *>(input.data());
+        this->setg(data, data, data + input.size());
+    }
+};
+
+// code table decoded by an earlier block, delta tables are also keyed by
+// the code they change
+struct cached_table
+{
+    std::shared_ptr<const shared_code> previous;
+    std::string payload;
+    std::shared_ptr<const shared_code> code;
+};
+
+std::shared_ptr<const shared_code>
+decode_cached_table(std::deque<cached_table> &tables,
+                    const std::string &payload,
+                    const std::shared_ptr<const shared_code> &previous)
+{
+    for (auto it = tables.begin(); it != tables.end(); ++it)
+    {
+        if (it->previous != previous || it->payload != payload)
+            continue;
+        auto code = it->code;
+        // the most recently used table stays in front
+        std::rotate(tables.begin(), it, std::next(it));
+        return code;
+    }
+
+    auto code = block_codec::decode_table(payload, previous.get());
+    tables.push_front(cached_table{previous, payload, code});
+    if (tables.size() > cached_tables)
+        tables.pop_back();
+    return code;
+}
+
+// codes data into the block container, blocks keep the previous code table
+// like in huffman_encoder when the options ask for it
+void compress_payload(const compression_options &options,
+                      const std::string &input, std::string &output,
+                      std::string &payload)
+{
+    memory_buf buffer(output);
+    std::ostream out(&buffer);
+    write_container_header(out, options.pipeline, input.size());
+
+    const block_codec codec(options);
+    const size_t block_size =
+        std::min<size_t>(std::min(options.block_size, size_16_mb), UINT32_MAX);
+    const bool reuse = options.reuse_tables && !options.stored &&
+                       options.pipeline == block_pipeline::HUFFMAN;
+    std::shared_ptr<const shared_code> shared;
+    const auto *data = reinterpret_cast<const uint8_t *>(input.data());
+    for (size_t begin = 0; begin < input.size(); begin += block_size)
+    {
+        const size_t size = std::min(block_size, input.size() - begin);
+        block_type type = block_type::STORED;
+        if (options.stored)
+            payload.assign(input, begin, size);
+        else if (reuse)
+        {
+            freq_map map(UINT8_MAX + 1);
+            canonical_code code = codec.byte_code(data + begin, size, map);
+            if (!shared ||
+                !codec.reuses_table(shared->code, code, map, size))
+            {
+                block_codec::encode_table(code, payload,
+                                          shared ? &shared->code : nullptr);
+                write_block_header(out,
+                                   shared ? block_type::DELTA_TABLE
+                                          : block_type::CODE_TABLE,
+                                   0, static_cast<uint32_t>(payload.size()));
+                out.write(payload.data(),
+                          static_cast<std::streamsize>(payload.size()));
+                shared = std::make_shared<const shared_code>(
+                    std::move(code),
+                    input.size() >= huffman_kernels::pair_codes_min_size);
+            }
+            codec.encode(*shared, data + begin, size, payload, type);
+        }
+        else
+            codec.encode(data + begin, size, payload, type);
+
+        write_block_header(out, type, static_cast<uint32_t>(size),
+                           static_cast<uint32_t>(payload.size()));
+        out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+    }
+    write_block_header(out, block_type::END, 0, 0);
+}
+
+// decodes the block container or the old format into output
+void decompress_payload(const std::string &input, std::string &output,
+                        std::string &payload,
+                        std::deque<cached_table> &tables)
+{
+    std::string unused;
+    memory_buf buffer(input, unused);
+    std::iostream in(&buffer);
+    block_pipeline pipeline = block_pipeline::HUFFMAN;
+    uint64_t original_size = unknown_size;
+    if (!read_container_header(in, pipeline, original_size))
+    {
+        bit_file_io bits(in, size_1_mb, 1);
+        freq_map map;
+        const std::unique_ptr<const huffman_tree> tree(
+            read_file_header(in, bits, map));
+        if (map.total() > max_payload_size)
+            throw std::logic_error("Data is too large.");
+        // every byte takes at least one bit, so a forged header can't size
+        // the output beyond the received data
+        if (map.total() > static_cast<uint64_t>(input.size()) * 8)
+            throw std::logic_error("File is truncated.");
+        const huffman_kernels kernels(*tree);
+        output.resize(static_cast<size_t>(map.total()));
+        if (!output.empty())
+            kernels.decode(bits, reinterpret_cast<uint8_t *>(&output[0]),
+                           output.size());
+        return;
+    }
+
+    const uint64_t limit =
+        original_size == unknown_size ? max_payload_size : original_size;
+    if (limit > max_payload_size)
+        throw std::logic_error("Data is too large.");
+    // the output grows with the decoded blocks, reserving the size from the
+    // header would let a forged one allocate it up front
+
+    compression_options options;
+    options.pipeline = pipeline;
+    const block_codec codec(options);
+    std::shared_ptr<const shared_code> shared;
+    uint32_t size = 0, payload_size = 0;
+    block_type type;
+    while ((type = read_block_header(in, size, payload_size)) !=
+           block_type::END)
+    {
+        if (size > size_16_mb ||
+            payload_size > block_codec::max_payload_size(size))
+            throw std::logic_error("Invalid block header.");
+        if (output.size() + size > limit)
+            throw std::logic_error(original_size == unknown_size
+                                       ? "Data is too large."
+                                       : "Compressed data is corrupted.");
+        payload.resize(payload_size);
+        if (!in.read(&payload[0], static_cast<std::streamsize>(payload_size)))
+            throw std::logic_error("File is truncated.");
+
+        if (type == block_type::CODE_TABLE)
+        {
+            shared = decode_cached_table(tables, payload, nullptr);
+            continue;
+        }
+        if (type == block_type::DELTA_TABLE)
+        {
+            if (!shared)
+                throw std::logic_error("Compressed data is corrupted.");
+            shared = decode_cached_table(tables, payload, shared);
+            continue;
+        }
+        const size_t begin = output.size();
+        output.resize(begin + size);
+        codec.decode(type, payload, reinterpret_cast<uint8_t *>(&output[begin]),
+                     size, shared.get());
+    }
+    if (original_size != unknown_size && output.size() != original_size)
+        throw std::logic_error("File is truncated.");
+}
+
+// bytes received from a connection, the ones before begin are consumed
+struct connection_input
+{
+    int fd = -1;
+    std::string buffer;
+    size_t begin = 0;
+};
+
+} // namespace
+
+// everything one pool thread reuses between requests
+struct huffman_server::worker
+{
+    server_ui ui;
+    huffman_encoder encoder;
+    connection_input input;
+    std::string line, request, response, payload;
+    std::deque<cached_table> tables;
+
+    explicit worker(const io_mode mode) : encoder("", "", this->ui)
+    {
+        this->encoder.set_io_mode(mode);
+    }
+
+    // one large request mustn't keep its memory for the life of the worker
+    void trim()
+    {
+        for (std::string *buffer : {&this->request, &this->response,
+                                    &this->payload, &this->input.buffer})
+            if (buffer->capacity() > kept_buffer_size)
+                std::string().swap(*buffer);
+    }
+};
+
+huffman_server::huffman_server(std::string socket_path, const ui &ui,
+                               const unsigned threads, const io_mode mode)
+    : socket_path_(std::move(socket_path)), ui_(ui),
+      threads_(threads ? threads
+                       : std::max(1U, std::thread::hardware_concurrency())),
+      io_mode_(mode)
+{
+}
+
+void huffman_server::record(const double seconds, const bool ok,
+                            const uint64_t bytes_in, const uint64_t bytes_out)
+{
+    const std::lock_guard<std::mutex> lock(this->stats_mutex_);
+    if (this->latencies_.size() < server_stats::latency_samples)
+        this->latencies_.push_back(seconds);
+    else
+        this->latencies_[this->stats_.requests %
+                         server_stats::latency_samples] = seconds;
+    this->stats_.requests++;
+    if (!ok)
+        this->stats_.errors++;
+    this->stats_.bytes_in += bytes_in;
+    this->stats_.bytes_out += bytes_out;
+}
+
+server_stats huffman_server::get_stats() const
+{
+    std::vector<double> latencies;
+    server_stats stats;
+    {
+        const std::lock_guard<std::mutex> lock(this->stats_mutex_);
+        latencies = this->latencies_;
+        stats = this->stats_;
+    }
+    if (latencies.empty())
+        return stats;
+
+    // nearest rank percentiles
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](const double p)
+    {
+        const auto rank = static_cast<size_t>(
+            std::ceil(p * static_cast<double>(latencies.size())));
+        return latencies[std::max<size_t>(rank, 1) - 1] * 1e3;
+    };
+    stats.p50_ms = percentile(0.5);
+    stats.p90_ms = percentile(0.9);
+    stats.p99_ms = percentile(0.99);
+    stats.max_ms = latencies.back() * 1e3;
+    return stats;
+}
+
+
+#ifndef _WIN32
+
+// receives more bytes of the connection, consumed bytes are dropped first
+static bool receive(connection_input &input)
+{
+    input.buffer.erase(0, input.begin);
+    input.begin = 0;
+    const size_t old_size = input.buffer.size();
+    input.buffer.resize(old_size + receive_size);
+    ssize_t received;
+    do
+        received = recv(input.fd, &input.buffer[old_size], receive_size, 0);
+    while (received < 0 && errno == EINTR);
+    input.buffer.resize(old_size +
+                        (received > 0 ? static_cast<size_t>(received) : 0));
+    return received > 0;
+}
+
+static bool read_line(connection_input &input, std::string &line)
+{
+    size_t end;
+    while ((end = input.buffer.find('\n', input.begin)) == std::string::npos)
+        if (input.buffer.size() - input.begin > max_line_length ||
+            !receive(input))
+            return false;
+    line.assign(input.buffer, input.begin, end - input.begin);
+    input.begin = end + 1;
+    return true;
+}
+
+// payloads go straight into data once the received bytes are used up, data
+// grows with the received bytes and not with the declared size
+static bool read_data(connection_input &input, std::string &data,
+                      const size_t size)
+{
+    const size_t buffered = std::min(size, input.buffer.size() - input.begin);
+    data.assign(input.buffer, input.begin, buffered);
+    input.begin += buffered;
+    while (data.size() < size)
+    {
+        const size_t done = data.size();
+        data.resize(done + std::min(size - done, receive_size));
+        ssize_t received;
+        do
+            received = recv(input.fd, &data[done], data.size() - done, 0);
+        while (received < 0 && errno == EINTR);
+        data.resize(done + (received > 0 ? static_cast<size_t>(received) : 0));
+        if (received <= 0)
+            return false;
+    }
+    return true;
+}
+
+static bool send_all(const int fd, const char *data, size_t size)
+{
+#ifdef MSG_NOSIGNAL
+    // a closed connection mustn't end the server with SIGPIPE
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    while (size > 0)
+    {
+        const ssize_t sent = send(fd, data, size, flags);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+static bool send_response(const int fd, const std::string &body)
+{
+    const std::string header = "OK " + std::to_string(body.size()) + "\n";
+    return send_all(fd, header.data(), header.size()) &&
+           send_all(fd, body.data(), body.size());
+}
+
+static bool send_error(const int fd, const std::string &error)
+{
+    const std::string response = "ERROR " + error + "\n";
+    return send_all(fd, response.data(), response.size());
+}
+
+huffman_server::~huffman_server()
+{
+    for (const int fd : {this->listen_fd_, this->wake_fds_[0],
+                         this->wake_fds_[1]})
+        if (fd >= 0)
+            close(fd);
+}
+
+void huffman_server::wake()
+{
+    // a full pipe already wakes run()
+    const char byte = 0;
+    while (write(this->wake_fds_[1], &byte, 1) < 0 && errno == EINTR)
+    {
+    }
+}
+
+void huffman_server::stop()
+{
+    const std::lock_guard<std::mutex> lock(this->queue_mutex_);
+    if (this->stopping_.exchange(true))
+        return;
+    // poll of run() and recv of workers return at once
+    this->wake();
+    for (const int fd : this->active_)
+        shutdown(fd, SHUT_RDWR);
+    this->queue_ready_.notify_all();
+}
+
+// a stalled client mustn't keep its worker for longer than the timeout
+static void set_timeouts(const int fd)
+{
+    timeval timeout{};
+    timeout.tv_sec = request_timeout_s;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+void huffman_server::run()
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (this->socket_path_.size() >= sizeof(address.sun_path))
+    {
+        this->ui_.app_error("Socket path is too long.");
+        return;
+    }
+    std::copy(this->socket_path_.begin(), this->socket_path_.end(),
+              address.sun_path);
+    unlink(this->socket_path_.c_str());
+
+    this->listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (this->listen_fd_ < 0 ||
+        bind(this->listen_fd_, reinterpret_cast<sockaddr *>(&address),
+             sizeof(address)) < 0 ||
+        listen(this->listen_fd_, SOMAXCONN) < 0)
+    {
+        this->ui_.app_error("Cannot listen on socket " + this->socket_path_ +
+                            ".");
+        return;
+    }
+    if (pipe(this->wake_fds_) < 0 ||
+        fcntl(this->wake_fds_[1], F_SETFL, O_NONBLOCK) < 0)
+    {
+        this->ui_.app_error("Cannot create server pipe.");
+        return;
+    }
+
+#ifdef __GLIBC__
+    // glibc raises the threshold after large buffers are freed and then keeps
+    // their memory in the heap, buffers freed by trim() have to go back to
+    // the system
+    mallopt(M_MMAP_THRESHOLD, static_cast<int>(kept_buffer_size));
+#endif
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < this->threads_; i++)
+        pool.emplace_back(
+            [this]
+            {
+                worker state(this->io_mode_);
+                this->serve(state);
+            });
+    this->ui_.write_message("Listening on " + this->socket_path_ + " with " +
+                            std::to_string(this->threads_) + " threads...");
+
+    // idle connections are polled here and go to the workers once they send
+    // a request, so clients keeping connections open don't hold the pool
+    std::vector<pollfd> polled;
+    while (!this->stopping_)
+    {
+        polled.clear();
+        polled.push_back(pollfd{this->listen_fd_, POLLIN, 0});
+        polled.push_back(pollfd{this->wake_fds_[0], POLLIN, 0});
+        {
+            const std::lock_guard<std::mutex> lock(this->queue_mutex_);
+            for (const int fd : this->idle_)
+                polled.push_back(pollfd{fd, POLLIN, 0});
+        }
+        if (poll(polled.data(), polled.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (polled[1].revents)
+        {
+            char bytes[64];
+            if (read(this->wake_fds_[0], bytes, sizeof(bytes)) < 0 &&
+                errno != EINTR)
+                break;
+        }
+        const std::lock_guard<std::mutex> lock(this->queue_mutex_);
+        // workers only append to idle_, the polled connections are still
+        // its beginning
+        const size_t count = polled.size() - 2;
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++)
+            if (polled[i + 2].revents)
+            {
+                // closed connections are also closed by the worker
+                this->connections_.push_back(this->idle_[i]);
+                this->queue_ready_.notify_one();
+            }
+            else
+                this->idle_[kept++] = this->idle_[i];
+        this->idle_.erase(this->idle_.begin() + static_cast<ptrdiff_t>(kept),
+                          this->idle_.begin() + static_cast<ptrdiff_t>(count));
+
+        if (polled[0].revents)
+        {
+            const int fd = accept(this->listen_fd_, nullptr, nullptr);
+            if (fd >= 0)
+            {
+                set_timeouts(fd);
+                this->idle_.push_back(fd);
+            }
+            else if (errno != EINTR && errno != ECONNABORTED)
+                break;
+        }
+    }
+    this->stop();
+    for (auto &thread : pool)
+        thread.join();
+
+    // connections nobody took before the shutdown
+    for (const int fd : this->connections_)
+        close(fd);
+    for (const int fd : this->idle_)
+        close(fd);
+    this->connections_.clear();
+    this->idle_.clear();
+    for (int *fd :
+         {&this->listen_fd_, &this->wake_fds_[0], &this->wake_fds_[1]})
+    {
+        close(*fd);
+        *fd = -1;
+    }
+    unlink(this->socket_path_.c_str());
+    this->ui_.write_message("Server stopped.");
+}
+
+void huffman_server::serve(worker &state)
+{
+    for (;;)
+    {
+        int fd;
+        {
+            std::unique_lock<std::mutex> lock(this->queue_mutex_);
+            this->queue_ready_.wait(lock,
+                                    [this] {
+                                        return this->stopping_ ||
+                                               !this->connections_.empty();
+                                    });
+            if (this->stopping_)
+                return;
+            fd = this->connections_.front();
+            this->connections_.pop_front();
+            this->active_.push_back(fd);
+        }
+        const bool open = this->serve_connection(fd, state);
+        {
+            const std::lock_guard<std::mutex> lock(this->queue_mutex_);
+            this->active_.erase(
+                std::find(this->active_.begin(), this->active_.end(), fd));
+            // the connection waits for its next request without a worker
+            if (open && !this->stopping_)
+            {
+                this->idle_.push_back(fd);
+                this->wake();
+                continue;
+            }
+        }
+        close(fd);
+    }
+}
+
+/**
+ * @brief Answers the requests the connection has sent. Returns false when
+ * the connection has to be closed, true when it waits for the next request
+ */
+bool huffman_server::serve_connection(const int fd, worker &state)
+{
+    state.input.fd = fd;
+    state.input.buffer.clear();
+    state.input.begin = 0;
+    bool open;
+    // a partly received request is read to the end, the timeouts bound it
+    do
+    {
+        open = this->handle_request(state);
+        state.trim();
+    } while (open && state.input.begin < state.input.buffer.size());
+    return open;
+}
+
+/**
+ * @brief Reads and answers one request. Returns false when the connection has
+ * to be closed: it was closed by the client, the request was malformed or
+ * the server is stopping
+ */
+bool huffman_server::handle_request(worker &state)
+{
+    const int fd = state.input.fd;
+    if (!read_line(state.input, state.line))
+        return false;
+    const auto started = stats_clock::now();
+    std::istringstream command(state.line);
+    std::string name;
+    command >> name;
+
+    if (name == "STATS")
+        return send_response(fd, this->get_stats().to_json());
+    if (name == "SHUTDOWN")
+    {
+        send_response(fd, std::string());
+        this->stop();
+        return false;
+    }
+
+    const bool compress = name == "COMPRESS" || name == "COMPRESS_FILE";
+    const bool file = name == "COMPRESS_FILE" || name == "DECOMPRESS_FILE";
+    if (!compress && !file && name != "DECOMPRESS")
+    {
+        send_error(fd, "Unknown request.");
+        return false;
+    }
+
+    int level = compression_options::max_level;
+    uint64_t size = 0;
+    if ((compress && !(command >> level)) || (!file && !(command >> size)) ||
+        level < compression_options::min_level ||
+        level > compression_options::max_level || size > max_payload_size)
+    {
+        send_error(fd, "Invalid request.");
+        return false;
+    }
+    compression_options options = compression_options::from_level(level);
+    // connections are coded in parallel, blocks of one request aren't
+    options.threads = 1;
+
+    std::string input_file, output_file, error;
+    if (file ? !read_line(state.input, input_file) ||
+                   !read_line(state.input, output_file)
+             : !read_data(state.input, state.request,
+                          static_cast<size_t>(size)))
+        return false;
+
+    uint64_t bytes_in = size;
+    state.response.clear();
+    try
+    {
+        if (file)
+        {
+            state.ui.clear();
+            state.encoder.set_files(input_file, output_file);
+            state.encoder.set_options(options);
+            if (compress)
+                state.encoder.compress_file();
+            else
+                state.encoder.decompress_file();
+            error = state.ui.error();
+            state.response = state.encoder.get_stats().to_json();
+            bytes_in = state.encoder.get_stats().bytes_in;
+        }
+        else if (compress)
+            compress_payload(options, state.request, state.response,
+                             state.payload);
+        else
+            decompress_payload(state.request, state.response, state.payload,
+                               state.tables);
+    }
+    catch (const std::exception &ex)
+    {
+        error = ex.what();
+    }
+
+    // recorded before the response, so the client's next STATS includes it
+    const bool ok = error.empty();
+    const double seconds =
+        std::chrono::duration<double>(stats_clock::now() - started).count();
+    this->record(seconds, ok, bytes_in, ok ? state.response.size() : 0);
+    const bool sent =
+        ok ? send_response(fd, state.response) : send_error(fd, error);
+    return sent && !this->stopping_;
+}
+
+#else
+
+huffman_server::~huffman_server() = default;
+
+void huffman_server::run()
+{
+    this->ui_.app_error("Server mode is not supported on this platform.");
+}
+
+#endif
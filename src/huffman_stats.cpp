@@ -0,0 +1,99 @@
+﻿#include "../inc/huffman_stats.h"
+
+#include <cmath>
+#include <sstream>
+
+void huffman_stats::set_code_stats(const freq_map &map,
+                                   const huffman_tree &tree)
+{
+    const auto codes = tree.get_codes();
+    this->code_stats_measured = true;
+    this->encoded_bits_measured = true;
+    uint64_t total = 0;
+    this->encoded_bits = 0;
+    for (uint16_t chr = 0; chr <= UINT8_MAX; chr++)
+    {
+        const uint64_t freq = map.get(static_cast<uint8_t>(chr));
+        this->code_lengths[chr] =
+            freq ? static_cast<uint8_t>(codes[chr].size()) : 0;
+        total += freq;
+        this->encoded_bits += freq * codes[chr].size();
+    }
+
+    this->average_code_length = 0;
+    this->entropy = 0;
+    if (total == 0)
+        return;
+
+    this->average_code_length = static_cast<double>(this->encoded_bits) /
+                                static_cast<double>(total);
+    for (uint16_t chr = 0; chr <= UINT8_MAX; chr++)
+    {
+        if (const uint64_t freq = map.get(static_cast<uint8_t>(chr)))
+        {
+            const double p =
+                static_cast<double>(freq) / static_cast<double>(total);
+            this->entropy -= p * std::log2(p);
+        }
+    }
+}
+
+double huffman_stats::compression_ratio() const
+{
+    if (this->compressed_size == 0)
+        return 0;
+    return static_cast<double>(this->original_size) /
+           static_cast<double>(this->compressed_size);
+}
+
+double huffman_stats::throughput_mb_s() const
+{
+    if (this->total_seconds <= 0)
+        return 0;
+    return static_cast<double>(this->original_size) / 1e6 /
+           this->total_seconds;
+}
+
+std::string huffman_stats::to_json() const
+{
+    std::ostringstream ss;
+    ss << "{\"operation\":\"" << this->operation << "\""
+       << ",\"bytes_in\":" << this->bytes_in
+       << ",\"bytes_out\":" << this->bytes_out
+       << ",\"original_size\":" << this->original_size
+       << ",\"compressed_size\":" << this->compressed_size
+       << ",\"compression_ratio\":" << this->compression_ratio();
+    if (this->encoded_bits_measured)
+        ss << ",\"average_code_length\":" << this->average_code_length;
+    if (this->code_stats_measured)
+        ss << ",\"entropy\":" << this->entropy;
+    if (this->encoded_bits_measured)
+        ss << ",\"encoded_bits\":" << this->encoded_bits;
+    ss << ",\"throughput_mb_s\":" << this->throughput_mb_s() << ",\"phases\":{";
+    if (this->histogram_measured)
+        ss << "\"histogram\":" << this->histogram_seconds << ",";
+    if (this->code_stats_measured)
+        ss << "\"tree_build\":" << this->tree_build_seconds << ",";
+    ss << "\"header\":" << this->header_seconds
+       << ",\"transform\":" << this->transform_seconds
+       << ",\"flush\":" << this->flush_seconds
+       << ",\"total\":" << this->total_seconds << "}";
+    if (!this->code_stats_measured)
+    {
+        ss << "}";
+        return ss.str();
+    }
+
+    ss << ",\"code_lengths\":{";
+    bool first = true;
+    for (uint16_t chr = 0; chr <= UINT8_MAX; chr++)
+    {
+        if (this->code_lengths[chr] == 0)
+            continue;
+        ss << (first ? "" : ",") << "\"" << chr
+           << "\":" << static_cast<unsigned>(this->code_lengths[chr]);
+        first = false;
+    }
+    ss << "}}";
+    return ss.str();
+}
@@ -45,10 +45,11 @@ huffman_tree::huffman_tree(const freq_map &chars_freq) : chars_freq_(chars_freq)
                         decltype(comp)>
 	pq(comp);
 
-    for (uint16_t chr = 0; chr <= UINT8_MAX; chr++)
+    const size_t alphabet_size = this->chars_freq_.alphabet_size();
+    for (size_t chr = 0; chr < alphabet_size; chr++)
         if (const uint64_t freq =
-                this->chars_freq_.get(static_cast<uint8_t>(chr)))
-            pq.push(new huffman_leaf(freq, static_cast<uint8_t>(chr)));
+                this->chars_freq_.get(static_cast<uint16_t>(chr)))
+            pq.push(new huffman_leaf(freq, static_cast<uint16_t>(chr)));
 
     if (pq.empty())
         throw std::logic_error("Cannot create tree with 0 unique bytes.");
@@ -75,7 +76,7 @@ huffman_tree::huffman_tree(const freq_map &chars_freq) : chars_freq_(chars_freq)
     tree_root_ = pq.top();
     pq.pop();
 
-    codes_ = new std::vector<uint8_t>[UINT8_MAX + 1];
+    codes_ = new std::vector<uint8_t>[alphabet_size];
     fill_codes(this->tree_root_, {});
 }
 
@@ -87,16 +88,21 @@ huffman_tree::~huffman_tree()
 
 bool huffman_tree::try_get_byte(uint8_t &byte, uint8_t code_bit) const
 {
-    static huffman_node *current_node = this->tree_root_;
+    if (this->current_node_ == nullptr)
+        this->current_node_ = this->tree_root_;
+
     if (code_bit)
-        current_node = current_node->get_right_child();
+        this->current_node_ = this->current_node_->get_right_child();
     else
-        current_node = current_node->get_left_child();
+        this->current_node_ = this->current_node_->get_left_child();
+
+    if (this->current_node_ == nullptr)
+        throw std::logic_error("Compressed data is corrupted.");
 
-    if (const auto leaf = dynamic_cast<huffman_leaf *>(current_node))
+    if (const auto leaf = dynamic_cast<const huffman_leaf *>(this->current_node_))
     {
-        byte = leaf->get_value();
-        current_node = this->tree_root_;
+        byte = static_cast<uint8_t>(leaf->get_value());
+        this->current_node_ = this->tree_root_;
         return true;
     }
     return false;
@@ -111,6 +117,8 @@ void huffman_tree::fill_codes(huffman_node *root, std::vector<uint8_t> current)
 
     if (const auto leaf = dynamic_cast<huffman_leaf *>(root))
     {
+        if (current.size() > this->max_code_length_)
+            this->max_code_length_ = static_cast<uint16_t>(current.size());
         this->codes_[leaf->get_value()] = std::move(current);
         return;
     }
@@ -0,0 +1,709 @@
+﻿#include "../inc/huffman_verifier.h"
+
+#include "../inc/bit_file_io.h"
+#include "../inc/block_codec.h"
+#include "../inc/huffman_encoder.h"
+#include "../inc/huffman_format.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+// small buffers, so buffer boundaries are crossed often
+static constexpr size_t io_buffer_size = 4093;
+static constexpr size_t chunk_size = 65521;
+// containers use small blocks, so tables are reused, changed and decoded in
+// batches of several blocks
+static constexpr size_t container_block_size = 4096;
+static constexpr size_t container_buffer_size = 65536;
+
+/**
+ * @brief Single encoder/decoder path, kernels == nullptr is the reference bit
+ * by bit path
+ */
+struct coding_path
+{
+    std::string name;
+    std::unique_ptr<huffman_kernels> kernels;
+};
+
+struct decode_result
+{
+    bool ok = false;
+    std::string output;
+    std::string error;
+};
+
+namespace
+{
+
+// ui of encoder runs, errors are kept instead of ending the program and
+// messages are dropped
+class recording_ui final : public ui
+{
+  private:
+    mutable std::string error_;
+
+  public:
+    void write_message(const std::string &msg) const override { UNUSED(msg); }
+    void app_error(const std::string &error_msg) const override
+    {
+        if (this->error_.empty())
+            this->error_ = error_msg;
+    }
+
+    const std::string &error() const { return this->error_; }
+};
+
+// file in the temporary directory, removed with the object
+class temp_file
+{
+  private:
+    const std::string path_;
+
+  public:
+    temp_file()
+        : path_((std::filesystem::temp_directory_path() /
+                 ("huffman_verify_" + std::to_string(std::random_device()())))
+                    .string())
+    {
+    }
+    ~temp_file() { std::remove(this->path_.c_str()); }
+    temp_file(const temp_file &) = delete;
+    temp_file &operator=(const temp_file &) = delete;
+
+    const std::string &path() const { return this->path_; }
+
+    bool write(const std::string &data) const
+    {
+        std::ofstream file(this->path_, std::ios::out | std::ios::binary |
+                                            std::ios::trunc);
+        return static_cast<bool>(
+            file.write(data.data(), static_cast<std::streamsize>(data.size())));
+    }
+
+    std::string read() const
+    {
+        std::ifstream file(this->path_, std::ios::in | std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(file)),
+                           std::istreambuf_iterator<char>());
+    }
+};
+
+// container decoder of huffman_encoder with one file access and thread count
+struct container_path
+{
+    const char *name;
+    io_mode mode;
+    unsigned threads;
+};
+
+} // namespace
+
+static const container_path container_paths[] = {
+    {"stream", io_mode::STREAM, 1},
+    {"stream/threads", io_mode::STREAM, 4},
+    {"raw/threads", io_mode::RAW, 4}};
+
+static const char *isa_name(const huffman_kernels::instruction_set isa)
+{
+    return isa == huffman_kernels::instruction_set::SCALAR ? "scalar"
+                                                           : "bmi2";
+}
+
+static const char *class_name(const huffman_kernels::length_class cls)
+{
+    switch (cls)
+    {
+    case huffman_kernels::length_class::UP_TO_8:
+        return "<=8";
+    case huffman_kernels::length_class::UP_TO_12:
+        return "<=12";
+    case huffman_kernels::length_class::UP_TO_16:
+        return "<=16";
+    case huffman_kernels::length_class::GENERAL:
+    default:
+        return "general";
+    }
+}
+
+// every kernel able to handle the tree: its own class and all wider ones
+static std::vector<coding_path>
+make_paths(const huffman_tree &tree,
+           const std::vector<huffman_kernels::instruction_set> &isas)
+{
+    std::vector<coding_path> paths;
+    paths.push_back({"reference", nullptr});
+    for (const auto isa : isas)
+    {
+        const auto natural = huffman_kernels(tree, isa).get_length_class();
+        for (auto cls = static_cast<uint8_t>(natural);
+             cls <= static_cast<uint8_t>(huffman_kernels::length_class::GENERAL);
+             cls++)
+        {
+            auto kernels = std::make_unique<huffman_kernels>(
+                tree, isa, static_cast<huffman_kernels::length_class>(cls));
+            std::string name = std::string(isa_name(isa)) + "/" +
+                               class_name(kernels->get_length_class());
+            // same class once more, encoded two bytes per lookup
+            auto pairs = std::make_unique<huffman_kernels>(
+                tree, isa, static_cast<huffman_kernels::length_class>(cls));
+            if (pairs->enable_pair_codes())
+                paths.push_back({name + "/pairs", std::move(pairs)});
+            paths.push_back({name, std::move(kernels)});
+        }
+    }
+    return paths;
+}
+
+static void encode_payload(const huffman_tree &tree, const coding_path &path,
+                           const uint8_t *data, const size_t size,
+                           bit_file_io &out)
+{
+    if (path.kernels == nullptr)
+    {
+        const auto codes = tree.get_codes();
+        for (size_t i = 0; i < size; i++)
+            for (const uint8_t bit : codes[data[i]])
+                out << bit;
+        return;
+    }
+
+    for (size_t i = 0; i < size; i += chunk_size)
+        path.kernels->encode(data + i, std::min(chunk_size, size - i), out);
+}
+
+static void decode_payload(const huffman_tree &tree, const coding_path &path,
+                           bit_file_io &in, uint64_t count,
+                           std::string &output)
+{
+    if (path.kernels == nullptr)
+    {
+        uint8_t bit = 0, byte = 0;
+        while (count > 0)
+        {
+            if (!(in >> bit))
+                throw std::logic_error("Compressed data is truncated.");
+            if (tree.try_get_byte(byte, bit))
+            {
+                output.push_back(static_cast<char>(byte));
+                count--;
+            }
+        }
+        return;
+    }
+
+    uint8_t buffer[chunk_size];
+    while (count > 0)
+    {
+        const size_t n = static_cast<size_t>(std::min<uint64_t>(count, chunk_size));
+        path.kernels->decode(in, buffer, n);
+        output.append(reinterpret_cast<char *>(buffer), n);
+        count -= n;
+    }
+}
+
+// decodes whole file with path_index-th path available for its tree, paths
+// are known only after the header is read
+static decode_result
+decode_file(const std::string &compressed, const size_t path_index,
+            const std::vector<huffman_kernels::instruction_set> &isas,
+            size_t &path_count, std::string &path_name)
+{
+    decode_result result;
+    std::stringstream ss(compressed,
+                         std::ios::in | std::ios::out | std::ios::binary);
+    bit_file_io in(ss, io_buffer_size, 1);
+    path_count = 1;
+    path_name = "reference";
+    try
+    {
+        freq_map map;
+        const std::unique_ptr<huffman_tree> tree(read_file_header(ss, in, map));
+        const auto paths = make_paths(*tree, isas);
+        path_count = paths.size();
+        path_name = paths[path_index].name;
+        decode_payload(*tree, paths[path_index], in, map.total(),
+                       result.output);
+        result.ok = true;
+    }
+    catch (const std::logic_error &ex)
+    {
+        result.error = ex.what();
+    }
+    return result;
+}
+
+static_assert(huffman_verifier::container_variants ==
+                  compression_options::max_level + 2,
+              "every level, run length coding and the sampled table");
+
+// every compression level, run length coding and a code table from a sample
+static compression_options container_options(const int variant)
+{
+    compression_options options;
+    options.block_format = true;
+    if (variant < compression_options::max_level)
+        options = compression_options::from_level(variant + 1);
+    else if (variant == compression_options::max_level)
+        options.pipeline = block_pipeline::RLE;
+    else
+        options.table_sample = container_block_size * 2;
+    options.block_size = container_block_size;
+    options.threads = 2;
+    return options;
+}
+
+// flips bits, cuts off the end or overwrites bytes, the header or a few
+// bytes anywhere, so block headers, code tables and transform parameters
+// get hit too
+static void corrupt(std::string &compressed, std::mt19937_64 &rng)
+{
+    auto random = [&rng](const uint64_t bound)
+    { return std::uniform_int_distribution<uint64_t>(0, bound - 1)(rng); };
+    switch (random(4))
+    {
+    case 0:
+        for (uint64_t flips = 1 + random(8); flips > 0; flips--)
+            compressed[random(compressed.size())] ^=
+                static_cast<char>(1 << random(8));
+        break;
+    case 1:
+        compressed.resize(random(compressed.size()));
+        break;
+    case 2:
+        for (size_t i = 0; i < std::min<size_t>(compressed.size(), 32); i++)
+            compressed[i] = static_cast<char>(random(256));
+        break;
+    default:
+        for (size_t i = random(compressed.size()), end = i + 1 + random(4);
+             i < std::min(end, compressed.size()); i++)
+            compressed[i] = static_cast<char>(random(256));
+        break;
+    }
+}
+
+static decode_result decode_container(const temp_file &input,
+                                      const temp_file &output,
+                                      const container_path &path)
+{
+    const recording_ui ui;
+    huffman_encoder encoder(input.path(), output.path(), ui,
+                            container_buffer_size);
+    compression_options options;
+    options.threads = path.threads;
+    encoder.set_options(options);
+    encoder.set_io_mode(path.mode);
+    encoder.decompress_file();
+
+    decode_result result;
+    result.ok = ui.error().empty();
+    result.error = ui.error();
+    if (result.ok)
+        result.output = output.read();
+    return result;
+}
+
+huffman_verifier::huffman_verifier(const ui &ui) : ui_(ui)
+{
+    this->instruction_sets_.push_back(huffman_kernels::instruction_set::SCALAR);
+    if (huffman_kernels::best_instruction_set() !=
+        huffman_kernels::instruction_set::SCALAR)
+        this->instruction_sets_.push_back(huffman_kernels::best_instruction_set());
+}
+
+bool huffman_verifier::report(const std::string &error) const
+{
+    this->ui_.write_message("Divergence: " + error);
+    return false;
+}
+
+bool huffman_verifier::verify_data(const uint8_t *data, const size_t size) const
+{
+    if (size == 0)
+        return true;
+
+    freq_map map;
+    for (size_t i = 0; i < size; i++)
+        map.inc(data[i]);
+    for (const auto isa : this->instruction_sets_)
+    {
+        freq_map counted;
+        huffman_kernels::count_bytes(data, size, counted, isa);
+        for (uint16_t chr = 0; chr <= UINT8_MAX; chr++)
+            if (counted.get(static_cast<uint8_t>(chr)) !=
+                map.get(static_cast<uint8_t>(chr)))
+                return this->report(std::string("histogram ") + isa_name(isa));
+    }
+
+    const huffman_tree tree(map);
+    const auto paths = make_paths(tree, this->instruction_sets_);
+    const uint8_t padding = code_padding(map, tree);
+
+    std::string reference;
+    for (const auto &path : paths)
+    {
+        std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
+        {
+            bit_file_io out(ss, 1, io_buffer_size);
+            write_file_header(map, padding, ss, out);
+            encode_payload(tree, path, data, size, out);
+            out.flush_bit_buffer();
+            out.flush_buffer();
+        }
+
+        if (path.kernels == nullptr)
+            reference = ss.str();
+        else if (ss.str() != reference)
+            return this->report("encoder " + path.name);
+    }
+
+    const std::string original(reinterpret_cast<const char *>(data), size);
+    size_t path_count = 0;
+    std::string path_name;
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        const auto result = decode_file(reference, i, this->instruction_sets_,
+                                        path_count, path_name);
+        if (!result.ok)
+            return this->report("decoder " + path_name + ": " + result.error);
+        if (result.output != original)
+            return this->report("decoder " + path_name);
+    }
+
+    // block format, every compression level and run length coding
+    for (int level = compression_options::min_level;
+         level <= compression_options::max_level + 1; level++)
+    {
+        compression_options options;
+        if (level <= compression_options::max_level)
+            options = compression_options::from_level(level);
+        else
+            options.pipeline = block_pipeline::RLE;
+        const block_codec codec(options);
+        const std::string name =
+            level <= compression_options::max_level
+                ? "block level " + std::to_string(level)
+                : std::string("block rle");
+        std::string payload;
+        block_type type = block_type::HUFFMAN;
+        std::vector<uint8_t> output(size);
+        try
+        {
+            codec.encode(data, size, payload, type);
+            codec.decode(type, payload, output.data(), size);
+        }
+        catch (const std::logic_error &ex)
+        {
+            return this->report(name + ": " + ex.what());
+        }
+        if (!std::equal(output.begin(), output.end(), data))
+            return this->report(name);
+    }
+
+    // shared code table from a sample, bytes missing in it still have codes,
+    // then a delta of it to the code of the whole data
+    freq_map sample(UINT8_MAX + 1);
+    for (size_t i = 0; i < size / 2; i++)
+        sample.inc(data[i]);
+    for (uint16_t chr = 0; chr <= UINT8_MAX; chr++)
+        sample.inc(chr);
+    const block_codec codec{compression_options()};
+    const shared_code shared(canonical_code(sample, 16));
+    freq_map block_map;
+    const shared_code changed(codec.byte_code(data, size, block_map));
+    for (const auto *code : {&shared, &changed})
+    {
+        const std::string name =
+            code == &shared ? "block shared table" : "block delta table";
+        std::string table, delta, payload;
+        block_type type = block_type::REUSE;
+        std::vector<uint8_t> output(size);
+        try
+        {
+            block_codec::encode_table(shared.code, table);
+            auto decoded = block_codec::decode_table(table);
+            if (code == &changed)
+            {
+                block_codec::encode_table(changed.code, delta, &shared.code);
+                decoded = block_codec::decode_table(delta, decoded.get());
+            }
+            codec.encode(*code, data, size, payload, type);
+            codec.decode(type, payload, output.data(), size, decoded.get());
+        }
+        catch (const std::logic_error &ex)
+        {
+            return this->report(name + ": " + ex.what());
+        }
+        if (!std::equal(output.begin(), output.end(), data))
+            return this->report(name);
+    }
+    return true;
+}
+
+bool huffman_verifier::verify_compressed(const uint8_t *data,
+                                         const size_t size) const
+{
+    const std::string compressed(reinterpret_cast<const char *>(data), size);
+
+    // reference pass also tells how many paths there are
+    size_t path_count = 0;
+    std::string path_name;
+    const auto reference = decode_file(compressed, 0, this->instruction_sets_,
+                                       path_count, path_name);
+
+    for (size_t i = 1; i < path_count; i++)
+    {
+        const auto result = decode_file(compressed, i, this->instruction_sets_,
+                                        path_count, path_name);
+        if (result.ok != reference.ok)
+            return this->report("decoder " + path_name + " " +
+                                (result.ok ? "accepted" : "rejected") +
+                                " data, reference " +
+                                (reference.ok ? "accepted" : "rejected: ") +
+                                reference.error);
+        if (result.ok && result.output != reference.output)
+            return this->report("decoder " + path_name);
+    }
+    return this->verify_container(compressed, nullptr);
+}
+
+// decodes the file with every container path, all of them have to agree and
+// give the expected output when there's one
+bool huffman_verifier::verify_container(const std::string &compressed,
+                                        const std::string *expected) const
+{
+    const temp_file input, output;
+    if (!input.write(compressed))
+        return this->report("cannot write " + input.path());
+
+    decode_result reference;
+    for (const auto &path : container_paths)
+    {
+        const std::string name = std::string("container decoder ") + path.name;
+        decode_result result;
+        try
+        {
+            result = decode_container(input, output, path);
+        }
+        catch (const std::exception &ex)
+        {
+            return this->report(name + " threw: " + ex.what());
+        }
+        if (expected != nullptr && (!result.ok || result.output != *expected))
+            return this->report(name + (result.ok ? "" : ": " + result.error));
+        if (&path == container_paths)
+        {
+            reference = std::move(result);
+            continue;
+        }
+        if (result.ok != reference.ok)
+            return this->report(name + " " +
+                                (result.ok ? "accepted" : "rejected") +
+                                " data, " + container_paths[0].name + " " +
+                                (reference.ok ? "accepted" : "rejected: ") +
+                                reference.error);
+        if (result.ok && result.output != reference.output)
+            return this->report(name);
+    }
+    return true;
+}
+
+bool huffman_verifier::verify_container_variant(const uint8_t *data,
+                                                const size_t size,
+                                                const int variant,
+                                                const uint64_t seed) const
+{
+    if (size == 0)
+        return true;
+
+    const std::string name = "container variant " + std::to_string(variant);
+    const std::string original(reinterpret_cast<const char *>(data), size);
+    std::string compressed;
+    {
+        const temp_file input, output;
+        if (!input.write(original))
+            return this->report("cannot write " + input.path());
+        const recording_ui ui;
+        huffman_encoder encoder(input.path(), output.path(), ui,
+                                container_buffer_size);
+        encoder.set_options(container_options(variant));
+        encoder.compress_file();
+        if (!ui.error().empty())
+            return this->report(name + ": " + ui.error());
+        compressed = output.read();
+    }
+    if (!this->verify_container(compressed, &original))
+        return this->report(name);
+
+    std::mt19937_64 rng(seed);
+    corrupt(compressed, rng);
+    if (!this->verify_container(compressed, nullptr))
+        return this->report(name + ", corrupted with seed " +
+                            std::to_string(seed));
+    return true;
+}
+
+bool huffman_verifier::verify_file(const std::string &path) const
+{
+    std::ifstream file(path, std::ios::in | std::ios_base::binary);
+    if (!file.good())
+        return this->report("cannot read " + path);
+
+    const std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                                    std::istreambuf_iterator<char>());
+    if (!this->verify_data(data.data(), data.size()) ||
+        !this->verify_compressed(data.data(), data.size()))
+        return false;
+
+    // containers are corrupted the same way every time the file is run, FNV-1a
+    // of the file is the seed
+    uint64_t seed = 14695981039346656037ULL;
+    for (const uint8_t byte : data)
+        seed = (seed ^ byte) * 1099511628211ULL;
+    for (int variant = 0; variant < container_variants; variant++)
+        if (!this->verify_container_variant(data.data(), data.size(), variant,
+                                            seed))
+            return false;
+    return true;
+}
+
+bool huffman_verifier::verify_random(const uint64_t seed,
+                                     const size_t iterations) const
+{
+    std::mt19937_64 rng(seed);
+    auto random = [&rng](const uint64_t bound)
+    { return std::uniform_int_distribution<uint64_t>(0, bound - 1)(rng); };
+
+    for (size_t iteration = 0; iteration < iterations; iteration++)
+    {
+        std::stringstream ss;
+        ss << "seed " << seed << ", case " << iteration;
+        const std::string name = ss.str();
+
+        std::vector<uint8_t> data;
+        const size_t size = 1 + random(1 << 17);
+        switch (random(5))
+        {
+        case 0: // uniform
+            for (size_t i = 0; i < size; i++)
+                data.push_back(static_cast<uint8_t>(random(256)));
+            break;
+        case 1: // skewed, short codes for few bytes and long tail
+        {
+            std::geometric_distribution<int> geometric(0.05 + random(50) / 100.0);
+            for (size_t i = 0; i < size; i++)
+                data.push_back(static_cast<uint8_t>(geometric(rng) & UINT8_MAX));
+            break;
+        }
+        case 2: // single byte
+            data.assign(size, static_cast<uint8_t>(random(256)));
+            break;
+        case 3: // fibonacci frequencies give the deepest possible tree
+        {
+            uint64_t a = 1, b = 1;
+            for (uint16_t chr = 0; chr < 26; chr++)
+            {
+                data.insert(data.end(), a, static_cast<uint8_t>(random(256)));
+                b += a;
+                a = b - a;
+            }
+            std::shuffle(data.begin(), data.end(), rng);
+            break;
+        }
+        default: // few bytes from a small alphabet
+        {
+            const uint64_t alphabet = 2 + random(30);
+            for (size_t i = 0; i < size; i++)
+                data.push_back(static_cast<uint8_t>('a' + random(alphabet)));
+            break;
+        }
+        }
+
+        if (!this->verify_data(data.data(), data.size()))
+            return this->report(name);
+
+        // adversarial input: a valid file corrupted by corrupt()
+        freq_map map;
+        for (const uint8_t byte : data)
+            map.inc(byte);
+        const huffman_tree tree(map);
+        std::stringstream file(std::ios::in | std::ios::out | std::ios::binary);
+        {
+            bit_file_io out(file, 1, io_buffer_size);
+            write_file_header(map, code_padding(map, tree), file, out);
+            encode_payload(tree, {"reference", nullptr}, data.data(),
+                           data.size(), out);
+            out.flush_bit_buffer();
+            out.flush_buffer();
+        }
+        std::string compressed = file.str();
+        corrupt(compressed, rng);
+        if (!this->verify_compressed(
+                reinterpret_cast<const uint8_t *>(compressed.data()),
+                compressed.size()))
+            return this->report(name);
+
+        // the same data in one of the block containers, valid and corrupted
+        const int variant = static_cast<int>(random(container_variants));
+        if (!this->verify_container_variant(data.data(), data.size(), variant,
+                                            rng()))
+            return this->report(name);
+    }
+
+    // codes longer than bit_file_io::max_bits can't come from real data of
+    // sane size, but any header may declare them
+    freq_map map;
+    uint64_t a = 1, b = 1;
+    for (uint16_t chr = 0; chr < 80; chr++)
+    {
+        map.set(static_cast<uint8_t>(chr), a);
+        b += a;
+        a = b - a;
+    }
+    const huffman_tree tree(map);
+    std::vector<uint8_t> data;
+    for (size_t i = 0; i < 10000; i++)
+        data.push_back(static_cast<uint8_t>(random(80)));
+
+    const auto paths = make_paths(tree, this->instruction_sets_);
+    std::string reference;
+    for (const auto &path : paths)
+    {
+        std::stringstream ss(std::ios::in | std::ios::out | std::ios::binary);
+        {
+            bit_file_io out(ss, 1, io_buffer_size);
+            encode_payload(tree, path, data.data(), data.size(), out);
+            out.flush_bit_buffer();
+            out.flush_buffer();
+        }
+        if (path.kernels == nullptr)
+            reference = ss.str();
+        else if (ss.str() != reference)
+            return this->report("long codes, encoder " + path.name);
+    }
+    for (const auto &path : paths)
+    {
+        std::stringstream ss(reference,
+                             std::ios::in | std::ios::out | std::ios::binary);
+        bit_file_io in(ss, io_buffer_size, 1);
+        std::string output;
+        try
+        {
+            decode_payload(tree, path, in, data.size(), output);
+        }
+        catch (const std::logic_error &ex)
+        {
+            return this->report("long codes, decoder " + path.name + ": " +
+                                ex.what());
+        }
+        if (output != std::string(data.begin(), data.end()))
+            return this->report("long codes, decoder " + path.name);
+    }
+    return true;
+}
@@ -0,0 +1,242 @@
+﻿#include "../inc/lz77.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+static constexpr uint8_t hash_bits = 15;
+
+// values are split into buckets of 2^precision codes per power of two,
+// small values get a code each, larger ones share a code with extra bits
+// telling the exact value
+template <uint8_t Precision> static uint16_t bucket_code(const uint32_t value)
+{
+    if (value < (2u << Precision))
+        return static_cast<uint16_t>(value);
+    uint8_t log = 0;
+    while ((value >> (log + 1)) != 0)
+        log++;
+    const uint8_t extra = log - Precision;
+    return static_cast<uint16_t>(((log - Precision + 1) << Precision) +
+                                 ((value >> extra) & ((1u << Precision) - 1)));
+}
+
+template <uint8_t Precision>
+static uint32_t bucket_base(const uint16_t code, uint8_t &extra)
+{
+    if (code < (2u << Precision))
+    {
+        extra = 0;
+        return code;
+    }
+    extra = static_cast<uint8_t>((code >> Precision) - 1);
+    return ((1u << Precision) | (code & ((1u << Precision) - 1))) << extra;
+}
+
+// lengths - lz77_min_match use 4 codes per power of two, distances - 1 use 2
+static constexpr uint8_t length_precision = 2;
+static constexpr uint8_t distance_precision = 1;
+
+static uint32_t hash3(const uint8_t *p)
+{
+    const uint32_t v = (static_cast<uint32_t>(p[0]) << 16) |
+                       (static_cast<uint32_t>(p[1]) << 8) | p[2];
+    return (v * 2654435761u) >> (32 - hash_bits);
+}
+
+namespace
+{
+
+struct lz77_match
+{
+    size_t length = 0;
+    size_t distance = 0;
+};
+
+} // namespace
+
+// shortest matches this far away take more bits than their literals
+static constexpr size_t min_match_max_distance = 4096;
+// matches this long are rarely beaten one byte later, lazy matching skips
+// them
+static constexpr size_t lazy_max_length = 32;
+// rough bits of one literal, matches are compared by the literal bits they
+// save minus the bits of their distance
+static constexpr int64_t literal_bits = 4;
+
+static int64_t match_gain(const lz77_match &match)
+{
+    if (match.length < lz77_min_match)
+        return 0;
+    int64_t distance_bits = 0;
+    while ((match.distance >> distance_bits) > 1)
+        distance_bits++;
+    return static_cast<int64_t>(match.length) * literal_bits - distance_bits;
+}
+
+void lz77_encode(const uint8_t *data, const size_t size,
+                 const lz77_params &params, lz77_block &block)
+{
+    block.literals.clear();
+    block.distances.clear();
+    block.extra_bits.clear();
+
+    // head[hash] -> last position with the hash, prev[pos % window] ->
+    // previous position with the same hash
+    constexpr size_t mask = lz77_window - 1;
+    std::vector<int64_t> head(static_cast<size_t>(1) << hash_bits, -1);
+    std::vector<int64_t> prev(lz77_window, -1);
+    // positions below are in the hash chains
+    size_t inserted = 0;
+
+    // best match at pos, every earlier position is inserted first
+    auto search = [&](const size_t pos)
+    {
+        lz77_match best;
+        for (; inserted < pos; inserted++)
+            if (inserted + lz77_min_match <= size)
+            {
+                const uint32_t h = hash3(data + inserted);
+                prev[inserted & mask] = head[h];
+                head[h] = static_cast<int64_t>(inserted);
+            }
+        if (pos + lz77_min_match > size)
+            return best;
+
+        const size_t max_length = std::min(lz77_max_match, size - pos);
+        size_t chain = params.max_chain;
+        int64_t best_gain = 0;
+        for (int64_t candidate = head[hash3(data + pos)];
+             candidate >= 0 && chain > 0 &&
+             pos - static_cast<size_t>(candidate) < lz77_window;
+             candidate = prev[static_cast<size_t>(candidate) & mask], chain--)
+        {
+            const uint8_t *match = data + candidate;
+            // can't be longer unless it matches at the current best end
+            if (match[best.length] != data[pos + best.length])
+                continue;
+            size_t length = 0;
+            while (length < max_length && match[length] == data[pos + length])
+                length++;
+            const lz77_match found{length,
+                                   pos - static_cast<size_t>(candidate)};
+            if (length <= best.length ||
+                (length == lz77_min_match &&
+                 found.distance > min_match_max_distance))
+                continue;
+            // a longer match from much farther away can cost more than
+            // it saves
+            const int64_t gain = match_gain(found);
+            if (gain <= best_gain)
+                continue;
+            best = found;
+            best_gain = gain;
+            if (length >= params.nice_length || length == max_length)
+                break;
+        }
+        return best;
+    };
+
+    size_t i = 0;
+    lz77_match match = search(0);
+    while (i < size)
+    {
+        // with lazy matching a match waits one byte for a better one
+        if (match.length >= lz77_min_match && params.lazy &&
+            match.length < std::min(params.nice_length, lazy_max_length))
+        {
+            const lz77_match next = search(i + 1);
+            if (match_gain(next) > match_gain(match))
+            {
+                block.literals.push_back(data[i++]);
+                match = next;
+                continue;
+            }
+        }
+        if (match.length < lz77_min_match)
+        {
+            block.literals.push_back(data[i++]);
+            match = search(i);
+            continue;
+        }
+
+        uint8_t extra = 0;
+        const uint32_t length_value =
+            static_cast<uint32_t>(match.length - lz77_min_match);
+        const uint16_t length_code = bucket_code<length_precision>(length_value);
+        const uint32_t length_base =
+            bucket_base<length_precision>(length_code, extra);
+        block.literals.push_back(static_cast<uint16_t>(256 + length_code));
+        block.extra_bits.push_back(((length_value - length_base) << 8) | extra);
+
+        const uint32_t distance_value =
+            static_cast<uint32_t>(match.distance - 1);
+        const uint16_t distance_code =
+            bucket_code<distance_precision>(distance_value);
+        const uint32_t distance_base =
+            bucket_base<distance_precision>(distance_code, extra);
+        block.distances.push_back(static_cast<uint8_t>(distance_code));
+        block.extra_bits.push_back(((distance_value - distance_base) << 8) |
+                                   extra);
+
+        // positions inside the match are inserted by the next search, so
+        // they can be matched later
+        i += match.length;
+        match = search(i);
+    }
+}
+
+void lz77_decode(const uint16_t *literals, const size_t count,
+                 const uint8_t *distances, bit_file_io &in, uint8_t *out,
+                 const size_t size)
+{
+    size_t pos = 0, match = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint16_t symbol = literals[i];
+        if (symbol <= UINT8_MAX)
+        {
+            if (pos == size)
+                throw std::logic_error("Compressed data is corrupted.");
+            out[pos++] = static_cast<uint8_t>(symbol);
+            continue;
+        }
+
+        uint8_t extra = 0;
+        const uint16_t length_code = static_cast<uint16_t>(symbol - 256);
+        size_t length = bucket_base<length_precision>(length_code, extra);
+        if (extra)
+            length += in.read_bits(extra);
+        length += lz77_min_match;
+
+        const uint16_t distance_code = distances[match++];
+        if (distance_code >= lz77_distance_alphabet_size)
+            throw std::logic_error("Compressed data is corrupted.");
+        size_t distance = bucket_base<distance_precision>(distance_code, extra);
+        if (extra)
+            distance += in.read_bits(extra);
+        distance += 1;
+
+        if (in.overrun())
+            throw std::logic_error("Compressed data is truncated.");
+        if (distance > pos || length > size - pos)
+            throw std::logic_error("Compressed data is corrupted.");
+
+        // byte by byte, the match may overlap the bytes it produces
+        const uint8_t *src = out + pos - distance;
+        for (size_t k = 0; k < length; k++)
+            out[pos + k] = src[k];
+        pos += length;
+    }
+
+    if (pos != size)
+        throw std::logic_error("Compressed data is corrupted.");
+}
+
+size_t lz77_match_count(const uint16_t *literals, const size_t count)
+{
+    size_t matches = 0;
+    for (size_t i = 0; i < count; i++)
+        if (literals[i] > UINT8_MAX)
+            matches++;
+    return matches;
+}
@@ -1,24 +1,40 @@
 #include <cstdlib>
 #include <functional>
 #include <iostream>
+#include <random>
 #include <sstream>
 #include <vector>
 
 #include "../inc/consts.h"
 #include "../inc/huffman_encoder.h"
+#include "../inc/huffman_server.h"
 #include "../inc/huffman_tree.h"
+#include "../inc/huffman_verifier.h"
 #include "../inc/ui.h"
 
-static const console_ui console_ui;
+static console_ui console_ui;
 
 static const std::string mode_compress = "compress";
 static const std::string mode_decompress = "decompress";
+static const std::string mode_analyze = "analyze";
+static const std::string mode_verify = "verify";
+static const std::string mode_serve = "serve";
+
+static const std::string io_stream = "stream";
+static const std::string io_raw = "raw";
+static const std::string io_direct = "direct";
+
+// random cases checked by --mode verify without input file
+static constexpr size_t verify_iterations = 100;
 
 enum class mode
 {
     INVALID = 0,
     COMPRESS,
     DECOMPRESS,
+    ANALYZE,
+    VERIFY,
+    SERVE,
 };
 
 /**
@@ -84,8 +100,16 @@ int main(int argc, char *argv[])
     try
     {
         const std::string program_name = argv[0];
-        std::string input_file, output_file;
+        std::string input_file, output_file, socket_path;
         auto mode = mode::INVALID;
+        bool print_stats = false;
+        compression_options compression;
+        // -1..-9, the level is applied first and options given anywhere on
+        // the command line are applied over it
+        int level = 0;
+        std::vector<std::function<void(compression_options &)>> overrides;
+        io_mode io = io_mode::STREAM;
+        uint64_t seed = std::random_device()();
 
         std::vector<option> options{
             option("-h", "--help", "Prints help",
@@ -131,7 +155,8 @@ int main(int argc, char *argv[])
                 }),
             option("-m", "--mode",
                    "Compression algorithm mode <" + mode_compress + "|" +
-                       mode_decompress + "> [required]",
+                       mode_decompress + "|" + mode_analyze + "|" +
+                       mode_verify + "|" + mode_serve + "> [required]",
                    [argc, argv, &mode](int &i)
                    {
                        if (i + 1 >= argc)
@@ -140,9 +165,191 @@ int main(int argc, char *argv[])
                            mode = mode::COMPRESS;
                        else if (argv[i + 1] == mode_decompress)
                            mode = mode::DECOMPRESS;
+                       else if (argv[i + 1] == mode_analyze)
+                           mode = mode::ANALYZE;
+                       else if (argv[i + 1] == mode_verify)
+                           mode = mode::VERIFY;
+                       else if (argv[i + 1] == mode_serve)
+                           mode = mode::SERVE;
+                       i++;
+                   }),
+            option("-k", "--socket",
+                   "UNIX socket path for --mode " + mode_serve +
+                       ", --threads sets the number of connections served "
+                       "in parallel [required with " + mode_serve + "]",
+                   [argc, argv, &socket_path](int &i)
+                   {
+                       if (i + 1 >= argc)
+                           console_ui.app_error("Socket path not specified");
+                       socket_path = std::string(argv[i + 1]);
+                       i++;
+                   }),
+            option("-e", "--io",
+                   "File access <" + io_stream + "|" + io_raw + "|" +
+                       io_direct + ">, " + io_raw +
+                       " uses file descriptors and copies stored blocks "
+                       "inside the kernel, " + io_direct +
+                       " also bypasses the page cache [optional]",
+                   [argc, argv, &io](int &i)
+                   {
+                       if (i + 1 >= argc)
+                           console_ui.app_error("File access not specified");
+                       if (argv[i + 1] == io_stream)
+                           io = io_mode::STREAM;
+                       else if (argv[i + 1] == io_raw)
+                           io = io_mode::RAW;
+                       else if (argv[i + 1] == io_direct)
+                           io = io_mode::DIRECT;
+                       else
+                           console_ui.app_error("Unknown file access");
+                       i++;
+                   }),
+            option("-n", "--dry-run",
+                   "Same as --mode " + mode_analyze +
+                       ", reports compressed size of the single table format, "
+                       "entropy and code lengths without writing output, "
+                       "compression options can't be used [optional]",
+                   [&mode](int &i)
+                   {
+                       UNUSED(i);
+                       mode = mode::ANALYZE;
+                   }),
+            option("-a", "--analyze", "Alias for --dry-run [optional]",
+                   [&mode](int &i)
+                   {
+                       UNUSED(i);
+                       mode = mode::ANALYZE;
+                   }),
+            option("-r", "--seed",
+                   "Seed of random cases for --mode " + mode_verify +
+                       " without input file [optional]",
+                   [argc, argv, &seed](int &i)
+                   {
+                       if (i + 1 >= argc)
+                           console_ui.app_error("Seed not specified");
+                       seed = std::stoull(argv[i + 1]);
+                       i++;
+                   }),
+            option("-s", "--stats",
+                   "Prints statistics as JSON after finishing, other messages "
+                   "go to stderr [optional]",
+                   [&print_stats](int &i)
+                   {
+                       UNUSED(i);
+                       print_stats = true;
+                   }),
+            option("-l", "--rle",
+                   "Codes runs of repeated bytes before huffman coding, "
+                   "output uses block format [optional]",
+                   [&overrides](int &i)
+                   {
+                       UNUSED(i);
+                       overrides.push_back([](compression_options &o)
+                                           { o.pipeline = block_pipeline::RLE; });
+                   }),
+            option("-b", "--bwt",
+                   "Sorts blocks with Burrows-Wheeler transform and "
+                   "move-to-front before huffman coding, "
+                   "output uses block format [optional]",
+                   [&overrides](int &i)
+                   {
+                       UNUSED(i);
+                       overrides.push_back([](compression_options &o)
+                                           { o.pipeline = block_pipeline::BWT; });
+                   }),
+            option("-z", "--lz77",
+                   "Replaces repeated strings with LZ77 matches, literals, "
+                   "lengths and distances use separate huffman codes, "
+                   "output uses block format [optional]",
+                   [&overrides](int &i)
+                   {
+                       UNUSED(i);
+                       overrides.push_back([](compression_options &o)
+                                           { o.pipeline = block_pipeline::LZ77; });
+                   }),
+            option("-t", "--threads",
+                   "Number of blocks coded in parallel, defaults to number "
+                   "of hardware threads [optional]",
+                   [argc, argv, &overrides](int &i)
+                   {
+                       if (i + 1 >= argc)
+                           console_ui.app_error("Threads not specified");
+                       const auto threads =
+                           static_cast<unsigned>(std::stoul(argv[i + 1]));
+                       overrides.push_back([threads](compression_options &o)
+                                           { o.threads = threads; });
                        i++;
+                   }),
+            option("-p", "--sample",
+                   "Builds one huffman code from the given number of bytes "
+                   "of the input and codes it in a single pass, "
+                   "output uses block format [optional]",
+                   [argc, argv, &overrides](int &i)
+                   {
+                       if (i + 1 >= argc)
+                           console_ui.app_error("Sample size not specified");
+                       const size_t sample = std::stoull(argv[i + 1]);
+                       overrides.push_back([sample](compression_options &o)
+                                           { o.table_sample = sample; });
+                       i++;
+                   }),
+            option("-u", "--reuse-tables",
+                   "Blocks keep the huffman code of the previous block while "
+                   "their own code would save at most the given number of "
+                   "bytes, changed codes are written as deltas, "
+                   "output uses block format [optional]",
+                   [argc, argv, &overrides](int &i)
+                   {
+                       if (i + 1 >= argc)
+                           console_ui.app_error(
+                               "Reuse threshold not specified");
+                       const size_t threshold = std::stoull(argv[i + 1]);
+                       overrides.push_back(
+                           [threshold](compression_options &o)
+                           {
+                               o.block_format = true;
+                               o.reuse_tables = true;
+                               o.reuse_threshold = threshold;
+                           });
+                       i++;
+                   }),
+            option("-d", "--strided-sample",
+                   "Takes --sample from chunks spread over the whole input "
+                   "instead of its beginning [optional]",
+                   [&overrides](int &i)
+                   {
+                       UNUSED(i);
+                       overrides.push_back([](compression_options &o)
+                                           { o.strided_sample = true; });
                    })};
 
+        // -1 fastest ... -9 best ratio
+        static const char *level_descriptions[] = {
+            "stores blocks without coding",
+            "huffman codes from a sample of every block",
+            "huffman codes up to 12 bits",
+            "huffman codes up to 16 bits",
+            "LZ77 with short match search",
+            "LZ77 with lazy matching",
+            "LZ77 with long match search",
+            "LZ77 with optimal codes",
+            "BWT with optimal codes"};
+        for (int l = compression_options::min_level;
+             l <= compression_options::max_level; l++)
+        {
+            const std::string name = std::to_string(l);
+            options.emplace_back(
+                "-" + name, "--level-" + name,
+                std::string("Compression level, ") + level_descriptions[l - 1] +
+                    ", other compression options override it, "
+                    "output uses block format [optional]",
+                [l, &level](int &i)
+                {
+                    UNUSED(i);
+                    level = l;
+                });
+        }
+
         if (argc < 2)
             invalid_usage(program_name);
 
@@ -153,6 +360,56 @@ int main(int argc, char *argv[])
 
         if (mode == mode::INVALID)
             invalid_usage(program_name);
+        // stdout carries only the statistics, so they can be read as JSON
+        if (print_stats)
+            console_ui.set_message_stream(std::cerr);
+
+        if (level != 0)
+            compression = compression_options::from_level(level);
+        for (const auto &apply : overrides)
+            apply(compression);
+        // the analysis knows only the single table format
+        if (mode == mode::ANALYZE && compression.uses_blocks())
+            console_ui.app_error(
+                "Compression options can't be used with --mode analyze.");
+
+        if (mode == mode::VERIFY)
+        {
+            // with input file it's suitable as a file fuzzer target
+            const huffman_verifier verifier(console_ui);
+            if (input_file.empty())
+            {
+                std::stringstream ss;
+                ss << "Verifying random data, seed: " << seed;
+                console_ui.write_message(ss.str());
+            }
+            const bool ok = input_file.empty()
+                                ? verifier.verify_random(seed, verify_iterations)
+                                : verifier.verify_file(input_file);
+            // file fuzzers (AFL) record crashes, not exit codes, so a
+            // divergence found in a file aborts
+            if (!ok && !input_file.empty())
+            {
+                std::cerr << "Verification failed." << std::endl;
+                std::abort();
+            }
+            if (!ok)
+                console_ui.app_error("Verification failed.");
+            console_ui.write_message("Verification passed.");
+            return EXIT_SUCCESS;
+        }
+
+        if (mode == mode::SERVE)
+        {
+            if (socket_path.empty())
+                invalid_usage(program_name);
+            huffman_server server(socket_path, console_ui, compression.threads,
+                                  io);
+            server.run();
+            if (print_stats)
+                std::cout << server.get_stats().to_json() << std::endl;
+            return EXIT_SUCCESS;
+        }
 
         if (input_file.empty())
             invalid_usage(program_name);
@@ -161,6 +418,8 @@ int main(int argc, char *argv[])
             output_file = input_file + ".out";
 
         auto encoder = huffman_encoder(input_file, output_file, console_ui);
+        encoder.set_options(compression);
+        encoder.set_io_mode(io);
 
         switch (mode)
         {
@@ -170,6 +429,9 @@ int main(int argc, char *argv[])
         case mode::DECOMPRESS:
             encoder.decompress_file();
             break;
+        case mode::ANALYZE:
+            encoder.analyze_file();
+            break;
 
         case mode::INVALID:
         default:
@@ -177,6 +439,9 @@ int main(int argc, char *argv[])
             break;
         }
 
+        if (print_stats)
+            std::cout << encoder.get_stats().to_json() << std::endl;
+
         return EXIT_SUCCESS;
     }
     catch (const std::exception &ex)
@@ -0,0 +1,442 @@
+﻿#include "../inc/raw_file.h"
+
+#include "../inc/consts.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ios>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#include <share.h>
+#else
+#include <unistd.h>
+#endif
+
+// posix calls with their windows runtime counterparts, transfers are split
+// to what a single call accepts
+#ifdef _WIN32
+static int sys_open(const std::string &path, const bool write)
+{
+    int fd = -1;
+    _sopen_s(&fd, path.c_str(),
+             write ? _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY
+                   : _O_RDONLY | _O_BINARY,
+             _SH_DENYNO, _S_IREAD | _S_IWRITE);
+    return fd;
+}
+
+static int64_t sys_read(const int fd, void *data, const size_t size)
+{
+    return _read(fd, data,
+                 static_cast<unsigned>(std::min<size_t>(size, INT_MAX)));
+}
+
+static int64_t sys_write(const int fd, const void *data, const size_t size)
+{
+    return _write(fd, data,
+                  static_cast<unsigned>(std::min<size_t>(size, INT_MAX)));
+}
+
+static bool sys_seek(const int fd, const uint64_t position)
+{
+    return _lseeki64(fd, static_cast<int64_t>(position), SEEK_SET) >= 0;
+}
+
+static uint64_t sys_size(const int fd)
+{
+    const int64_t size = _filelengthi64(fd);
+    return size < 0 ? 0 : static_cast<uint64_t>(size);
+}
+
+static int sys_close(const int fd) { return _close(fd); }
+#else
+static int sys_open(const std::string &path, const bool write)
+{
+    const int fd = write
+                       ? open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)
+                       : open(path.c_str(), O_RDONLY);
+#ifdef POSIX_FADV_SEQUENTIAL
+    // input is read once from the beginning to the end
+    if (fd >= 0 && !write)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return fd;
+}
+
+static int64_t sys_read(const int fd, void *data, const size_t size)
+{
+    return read(fd, data, std::min<size_t>(size, INT_MAX));
+}
+
+static int64_t sys_write(const int fd, const void *data, const size_t size)
+{
+    return write(fd, data, std::min<size_t>(size, INT_MAX));
+}
+
+static bool sys_seek(const int fd, const uint64_t position)
+{
+    return lseek(fd, static_cast<off_t>(position), SEEK_SET) >= 0;
+}
+
+static uint64_t sys_size(const int fd)
+{
+    struct stat status;
+    return fstat(fd, &status) == 0 ? static_cast<uint64_t>(status.st_size) : 0;
+}
+
+static int sys_close(const int fd) { return close(fd); }
+#endif
+
+// extents are allocated up front, the file size stays so a shorter output
+// has no trailing zeros
+static bool allocate_fd(const int fd, const uint64_t size)
+{
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+    return size == 0 || fallocate(fd, FALLOC_FL_KEEP_SIZE, 0,
+                                  static_cast<off_t>(size)) == 0;
+#else
+    UNUSED(fd);
+    UNUSED(size);
+    return false;
+#endif
+}
+
+static bool is_aligned(const void *data, const size_t size,
+                       const uint64_t position)
+{
+    return reinterpret_cast<uintptr_t>(data) % raw_file::alignment == 0 &&
+           size % raw_file::alignment == 0 &&
+           position % raw_file::alignment == 0;
+}
+
+raw_file::raw_file(const std::string &path, const bool write,
+                   const bool direct)
+    : fd_(sys_open(path, write)), direct_(direct)
+{
+}
+
+raw_file::~raw_file() { this->close(); }
+
+void raw_file::set_direct(const bool on)
+{
+#ifdef O_DIRECT
+    if (!this->direct_ || on == this->direct_on_)
+        return;
+    const int flags = fcntl(this->fd_, F_GETFL);
+    if (flags < 0 || fcntl(this->fd_, F_SETFL,
+                           on ? flags | O_DIRECT : flags & ~O_DIRECT) < 0)
+    {
+        // file system without O_DIRECT, the page cache is used
+        this->direct_ = this->direct_on_ = false;
+        return;
+    }
+    this->direct_on_ = on;
+#else
+    UNUSED(on);
+    this->direct_ = false;
+#endif
+}
+
+uint64_t raw_file::size() const { return sys_size(this->fd_); }
+
+size_t raw_file::read(void *data, const size_t size)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        char *const begin = static_cast<char *>(data) + done;
+        this->set_direct(is_aligned(begin, size - done, this->position_));
+        const int64_t count = sys_read(this->fd_, begin, size - done);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0 && errno == EINVAL && this->direct_on_)
+        {
+            // the file system refused this O_DIRECT transfer, the rest of
+            // the file goes through the page cache
+            this->set_direct(false);
+            this->direct_ = false;
+            continue;
+        }
+        if (count < 0)
+            this->error_ = errno;
+        if (count <= 0)
+            break;
+        done += static_cast<size_t>(count);
+        this->position_ += static_cast<uint64_t>(count);
+    }
+    return done;
+}
+
+bool raw_file::write(const void *data, const size_t size)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        const char *const begin = static_cast<const char *>(data) + done;
+        this->set_direct(is_aligned(begin, size - done, this->position_));
+        const int64_t count = sys_write(this->fd_, begin, size - done);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        done += static_cast<size_t>(count);
+        this->position_ += static_cast<uint64_t>(count);
+    }
+    return true;
+}
+
+bool raw_file::seek(const uint64_t position)
+{
+    if (!sys_seek(this->fd_, position))
+        return false;
+    this->position_ = position;
+    return true;
+}
+
+uint64_t raw_file::copy_to(raw_file &output, const uint64_t size)
+{
+    uint64_t done = 0;
+#if defined(__linux__)
+    // the kernel copies between the files, when it refuses (older kernel,
+    // different file systems) the rest goes through a buffer
+    this->set_direct(false);
+    output.set_direct(false);
+    while (done < size)
+    {
+        const ssize_t count =
+            copy_file_range(this->fd_, nullptr, output.fd_, nullptr,
+                            static_cast<size_t>(size - done), 0);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            break;
+        done += static_cast<uint64_t>(count);
+        this->position_ += static_cast<uint64_t>(count);
+        output.position_ += static_cast<uint64_t>(count);
+    }
+#endif
+
+    std::vector<char> buffer(
+        static_cast<size_t>(std::min<uint64_t>(size - done, 1 << 20)));
+    while (done < size)
+    {
+        const size_t count = this->read(
+            buffer.data(), static_cast<size_t>(
+                               std::min<uint64_t>(size - done, buffer.size())));
+        if (count == 0 || !output.write(buffer.data(), count))
+            break;
+        done += count;
+    }
+    return done;
+}
+
+bool raw_file::allocate(const uint64_t size)
+{
+    return allocate_fd(this->fd_, size);
+}
+
+bool raw_file::allocate(const std::string &path, const uint64_t size)
+{
+#if defined(__linux__)
+    const int fd = open(path.c_str(), O_WRONLY);
+    if (fd < 0)
+        return false;
+    const bool allocated = allocate_fd(fd, size);
+    sys_close(fd);
+    return allocated;
+#else
+    UNUSED(path);
+    UNUSED(size);
+    return false;
+#endif
+}
+
+bool raw_file::close()
+{
+    if (this->fd_ < 0)
+        return true;
+    const bool closed = sys_close(this->fd_) == 0;
+    this->fd_ = -1;
+    return closed;
+}
+
+raw_file_buf::raw_file_buf(raw_file &file, const bool write,
+                           const size_t buffer_size)
+    : file_(file), write_(write),
+      storage_(new char[buffer_size + raw_file::alignment]),
+      buffer_size_(buffer_size)
+{
+    const auto address = reinterpret_cast<uintptr_t>(this->storage_);
+    this->buffer_ = this->storage_ + (raw_file::alignment -
+                                      address % raw_file::alignment) %
+                                         raw_file::alignment;
+    if (this->write_)
+        this->setp(this->buffer_, this->buffer_ + this->buffer_size_);
+    else
+        this->setg(this->buffer_, this->buffer_, this->buffer_);
+}
+
+raw_file_buf::~raw_file_buf()
+{
+    if (this->write_)
+        this->flush_put_area();
+    delete[] this->storage_;
+}
+
+bool raw_file_buf::flush_put_area()
+{
+    const auto count = static_cast<size_t>(this->pptr() - this->pbase());
+    const bool written =
+        count == 0 || this->file_.write(this->pbase(), count);
+    this->setp(this->buffer_, this->buffer_ + this->buffer_size_);
+    return written;
+}
+
+raw_file_buf::pos_type raw_file_buf::stream_position() const
+{
+    if (this->write_)
+        return static_cast<off_type>(this->file_.position() +
+                                     static_cast<uint64_t>(this->pptr() -
+                                                           this->pbase()));
+    return static_cast<off_type>(this->file_.position() -
+                                 static_cast<uint64_t>(this->egptr() -
+                                                       this->gptr()));
+}
+
+raw_file_buf::int_type raw_file_buf::underflow()
+{
+    if (this->write_)
+        return traits_type::eof();
+    if (this->gptr() < this->egptr())
+        return traits_type::to_int_type(*this->gptr());
+
+    const size_t count = this->file_.read(this->buffer_, this->buffer_size_);
+    this->setg(this->buffer_, this->buffer_, this->buffer_ + count);
+    if (count == 0 && this->file_.error())
+        throw std::ios_base::failure("Cannot read file.");
+    if (count == 0)
+        return traits_type::eof();
+    return traits_type::to_int_type(*this->gptr());
+}
+
+raw_file_buf::int_type raw_file_buf::overflow(const int_type ch)
+{
+    if (!this->write_ || !this->flush_put_area())
+        return traits_type::eof();
+    if (traits_type::eq_int_type(ch, traits_type::eof()))
+        return traits_type::not_eof(ch);
+    *this->pptr() = traits_type::to_char_type(ch);
+    this->pbump(1);
+    return ch;
+}
+
+std::streamsize raw_file_buf::xsgetn(char *data, const std::streamsize count)
+{
+    const auto size = static_cast<size_t>(count);
+    size_t done = 0;
+    while (done < size)
+    {
+        const auto buffered = static_cast<size_t>(this->egptr() - this->gptr());
+        if (buffered > 0)
+        {
+            const size_t part = std::min(buffered, size - done);
+            std::memcpy(data + done, this->gptr(), part);
+            this->gbump(static_cast<int>(part));
+            done += part;
+        }
+        else if (size - done >= this->buffer_size_ && !this->file_.direct())
+        {
+            // large reads go straight to the caller
+            const size_t requested = size - done;
+            const size_t part = this->file_.read(data + done, requested);
+            done += part;
+            if (part < requested && this->file_.error())
+                throw std::ios_base::failure("Cannot read file.");
+            if (part == 0)
+                break;
+        }
+        else if (traits_type::eq_int_type(this->underflow(),
+                                          traits_type::eof()))
+            break;
+    }
+    return static_cast<std::streamsize>(done);
+}
+
+std::streamsize raw_file_buf::xsputn(const char *data,
+                                     const std::streamsize count)
+{
+    if (!this->write_)
+        return 0;
+    const auto size = static_cast<size_t>(count);
+    if (size >= this->buffer_size_ && !this->file_.direct())
+    {
+        // large writes go straight to the file
+        if (!this->flush_put_area() || !this->file_.write(data, size))
+            return 0;
+        return count;
+    }
+
+    size_t done = 0;
+    while (done < size)
+    {
+        if (this->pptr() == this->epptr() && !this->flush_put_area())
+            break;
+        const size_t part = std::min(
+            static_cast<size_t>(this->epptr() - this->pptr()), size - done);
+        std::memcpy(this->pptr(), data + done, part);
+        this->pbump(static_cast<int>(part));
+        done += part;
+    }
+    return static_cast<std::streamsize>(done);
+}
+
+raw_file_buf::pos_type raw_file_buf::seekoff(const off_type offset,
+                                             const std::ios_base::seekdir dir,
+                                             const std::ios_base::openmode which)
+{
+    // tellg and tellp don't move
+    if (dir == std::ios_base::cur && offset == 0)
+        return this->stream_position();
+
+    off_type base = 0;
+    if (dir == std::ios_base::cur)
+        base = this->stream_position();
+    else if (dir == std::ios_base::end)
+    {
+        if (this->sync() != 0)
+            return pos_type(off_type(-1));
+        base = static_cast<off_type>(this->file_.size());
+    }
+    return this->seekpos(pos_type(base + offset), which);
+}
+
+raw_file_buf::pos_type raw_file_buf::seekpos(const pos_type position,
+                                             const std::ios_base::openmode which)
+{
+    UNUSED(which);
+    if (off_type(position) < 0 || this->sync() != 0 ||
+        !this->file_.seek(static_cast<uint64_t>(off_type(position))))
+        return pos_type(off_type(-1));
+    return position;
+}
+
+int raw_file_buf::sync()
+{
+    if (this->write_)
+        return this->flush_put_area() ? 0 : -1;
+
+    // bytes read ahead are dropped, the file is where the stream is
+    if (this->gptr() < this->egptr())
+    {
+        const pos_type position = this->stream_position();
+        this->setg(this->buffer_, this->buffer_, this->buffer_);
+        if (!this->file_.seek(static_cast<uint64_t>(off_type(position))))
+            return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,115 @@
+﻿#include "../inc/run_length.h"
+
+#include <cstring>
+#include <stdexcept>
+
+// bijective base 2 digits of repeat, least significant first, as in bzip2
+static void append_repeat(size_t repeat, std::vector<uint16_t> &symbols)
+{
+    while (repeat > 0)
+    {
+        symbols.push_back(repeat & 1 ? run_a : run_b);
+        repeat = (repeat - 1) >> 1;
+    }
+}
+
+void run_length_encode(const uint8_t *data, const size_t size,
+                       std::vector<uint16_t> &symbols)
+{
+    symbols.clear();
+    size_t i = 0;
+    while (i < size)
+    {
+        const uint8_t byte = data[i];
+        size_t end = i + 1;
+        while (end < size && data[end] == byte)
+            end++;
+
+        symbols.push_back(byte);
+        append_repeat(end - i - 1, symbols);
+        i = end;
+    }
+}
+
+// reads digits written by append_repeat starting at symbols[i], the repeat
+// can't be longer than limit
+static size_t read_repeat(const uint16_t *symbols, const size_t count,
+                          size_t &i, const size_t limit)
+{
+    size_t repeat = 0, weight = 1;
+    for (; i < count && symbols[i] > UINT8_MAX; i++)
+    {
+        repeat += symbols[i] == run_a ? weight : 2 * weight;
+        weight <<= 1;
+        if (repeat > limit)
+            throw std::logic_error("Compressed data is corrupted.");
+    }
+    return repeat;
+}
+
+void run_length_decode(const uint16_t *symbols, const size_t count,
+                       uint8_t *out, const size_t size)
+{
+    size_t pos = 0;
+    size_t i = 0;
+    while (i < count)
+    {
+        const uint16_t symbol = symbols[i++];
+        if (symbol > UINT8_MAX || pos == size)
+            throw std::logic_error("Compressed data is corrupted.");
+        const uint8_t byte = static_cast<uint8_t>(symbol);
+        out[pos++] = byte;
+
+        // digits can't describe more than the rest of the block
+        const size_t repeat = read_repeat(symbols, count, i, size - pos);
+        std::memset(out + pos, byte, repeat);
+        pos += repeat;
+    }
+
+    if (pos != size)
+        throw std::logic_error("Compressed data is corrupted.");
+}
+
+void zero_run_encode(const uint8_t *data, const size_t size,
+                     std::vector<uint16_t> &symbols)
+{
+    symbols.clear();
+    size_t i = 0;
+    while (i < size)
+    {
+        if (data[i] != 0)
+        {
+            symbols.push_back(data[i++]);
+            continue;
+        }
+
+        const size_t begin = i;
+        while (i < size && data[i] == 0)
+            i++;
+        append_repeat(i - begin, symbols);
+    }
+}
+
+void zero_run_decode(const uint16_t *symbols, const size_t count,
+                     uint8_t *out, const size_t size)
+{
+    size_t pos = 0;
+    size_t i = 0;
+    while (i < count)
+    {
+        if (symbols[i] <= UINT8_MAX)
+        {
+            if (pos == size)
+                throw std::logic_error("Compressed data is corrupted.");
+            out[pos++] = static_cast<uint8_t>(symbols[i++]);
+            continue;
+        }
+
+        const size_t repeat = read_repeat(symbols, count, i, size - pos);
+        std::memset(out + pos, 0, repeat);
+        pos += repeat;
+    }
+
+    if (pos != size)
+        throw std::logic_error("Compressed data is corrupted.");
+}
@@ -1,14 +1,59 @@
 ﻿#include "../inc/ui.h"
 
+#include <csignal>
 #include <iostream>
 
+static volatile std::sig_atomic_t interrupted = 0;
+
+// first ctrl+c asks for cooperative cancellation, second one kills
+static void on_interrupt(int signal)
+{
+	interrupted = 1;
+	std::signal(signal, SIG_DFL);
+}
+
+console_ui::console_ui() : messages_(&std::cout)
+{
+	std::signal(SIGINT, on_interrupt);
+}
+
+void console_ui::set_message_stream(std::ostream& messages)
+{
+	this->messages_ = &messages;
+}
+
+// progress is printed without new line, terminate it before other output
+void console_ui::end_progress_line() const
+{
+	if (this->last_percent_ < 0)
+		return;
+	std::cerr << std::endl;
+	this->last_percent_ = -1;
+}
+
 void console_ui::write_message(const std::string& msg) const
 {
-	std::cout << msg << std::endl;
+	this->end_progress_line();
+	*this->messages_ << msg << std::endl;
 }
 
 void console_ui::app_error(const std::string& error_msg) const
 {
+	this->end_progress_line();
 	std::cerr << error_msg << std::endl;
 	exit(EXIT_FAILURE);
 }
+
+bool console_ui::report_progress(uint64_t processed, uint64_t total) const
+{
+	const int percent =
+		total ? static_cast<int>(processed * 100.0 / static_cast<double>(total))
+			  : 100;
+	if (percent != this->last_percent_)
+	{
+		this->last_percent_ = percent;
+		std::cerr << "\rProgress: " << percent << "%";
+		std::cerr.flush();
+	}
+	return !interrupted;
+}